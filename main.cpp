@@ -1,6 +1,80 @@
 #include <iostream>
 #include <chrono>
+#include <csignal>
+#include <cstring>
+#include <filesystem>
 #include "SceneLoader.hpp"
+#include "ObjCache.hpp"
+#include "RenderServer.hpp"
+#include "RenderJob.hpp"
+#include "ThreadPool.hpp"
+#include "TileCoordinator.hpp"
+
+std::atomic<bool> interrupted(false);
+
+void onInterrupt(int)
+{
+  interrupted = true;
+}
+
+/**
+ * Renders all the jobs of a manifest in this process.
+ * Scenes and OBJ files are shared between jobs, and the PNG encoding of a job
+ * runs on the thread pool while the next job is rendered.
+ */
+int renderBatch(std::string manifestPath)
+{
+  std::vector<RenderJob> jobs;
+  try
+  {
+    jobs = RenderJob::loadManifest(manifestPath);
+  }
+  catch (std::exception const &e)
+  {
+    std::cerr << "[ERROR] " << e.what() << std::endl;
+    return 1;
+  }
+
+  SceneCache cache;
+  ThreadPool &pool = ThreadPool::shared();
+  std::vector<std::future<void>> writes;
+  int failures = 0;
+
+  auto begin = std::chrono::high_resolution_clock::now();
+  for (RenderJob &job : jobs)
+  {
+    try
+    {
+      Image *image = job.render(cache);
+      std::string outpath = job.outputPath;
+      PngSettings png = job.png;
+      // Encoding overlaps with the rendering of the next job
+      writes.push_back(pool.submit([image, outpath, png]() mutable
+                                   {
+                                     image->writeFile(outpath, png);
+                                     delete image;
+                                   }));
+      std::cout << "Rendered " << job.scenePath << " -> " << outpath << std::endl;
+    }
+    catch (std::exception const &e)
+    {
+      std::cerr << "[ERROR] " << job.scenePath << ": " << e.what() << std::endl;
+      failures++;
+    }
+  }
+
+  for (auto &write : writes)
+  {
+    pool.wait(write);
+    write.get();
+  }
+  auto end = std::chrono::high_resolution_clock::now();
+  auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin);
+
+  std::printf("Rendered %d/%d jobs.\n", (int)(jobs.size() - failures), (int)jobs.size());
+  std::printf("Total time: %.3f seconds.\n", elapsed.count() * 1e-9);
+  return failures == 0 ? 0 : 1;
+}
 
 int main(int argc, char *argv[])
 {
@@ -13,23 +87,231 @@ int main(int argc, char *argv[])
   if (argc < 2)
   {
     std::cerr << "[ERROR] Please a path your scene file (.json)" << std::endl;
+    std::cerr << "        options: [output.png] [--png-level 0-9] [--png-filter none|sub|paeth|minsum|entropy] [--png-threads N]" << std::endl;
+    std::cerr << "                 [--progressive [--spp N] [--max-time S] [--preview-interval S] [--preview file.png]]" << std::endl;
+    std::cerr << "                 [--time-budget S [--spp N]]" << std::endl;
+    std::cerr << "                 [--region x0,y0,x1,y1] [--tiles N] [--workers socket1,socket2,...]" << std::endl;
+    std::cerr << "        or render a list of jobs with: --batch <manifest.json>" << std::endl;
+    std::cerr << "        or start a render server with: --serve <socket path>" << std::endl;
     std::cout << std::endl;
     exit(0);
   }
 
-  std::string path = argv[1];
-  auto [scene, camera, image] = SceneLoader::Load(path);
+  if (std::strcmp(argv[1], "--serve") == 0)
+  {
+    if (argc < 3)
+    {
+      std::cerr << "[ERROR] Please a path for the server socket" << std::endl;
+      return 1;
+    }
+    RenderServer server(argv[2]);
+    return server.run();
+  }
 
+  if (std::strcmp(argv[1], "--batch") == 0)
+  {
+    if (argc < 3)
+    {
+      std::cerr << "[ERROR] Please a path your batch manifest (.json)" << std::endl;
+      return 1;
+    }
+    return renderBatch(argv[2]);
+  }
+
+  std::string path = argv[1];
   std::string outpath = "image.png";
-  if (argc > 2)
+  PngSettings png;
+  bool progressive = false;
+  double timeBudget = 0;
+  bool hasRegion = false;
+  ImageRegion region;
+  unsigned int tileProcesses = 0;
+  std::vector<std::string> workers;
+  ProgressiveSettings progressiveSettings;
+  std::string previewPath;
+
+  try
+  {
+    bool hasOutpath = false;
+    for (int i = 2; i < argc; ++i)
+    {
+      std::string arg = argv[i];
+      if (arg.rfind("--", 0) != 0 && !hasOutpath)
+      {
+        outpath = arg;
+        hasOutpath = true;
+      }
+      else if (arg == "--png-level" && i + 1 < argc)
+      {
+        png.level = std::stoi(argv[++i]);
+      }
+      else if (arg == "--png-filter" && i + 1 < argc)
+      {
+        png.filter = PngSettings::parseFilter(argv[++i]);
+      }
+      else if (arg == "--png-threads" && i + 1 < argc)
+      {
+        png.threads = std::stoi(argv[++i]);
+      }
+      else if (arg == "--progressive")
+      {
+        progressive = true;
+      }
+      else if (arg == "--spp" && i + 1 < argc)
+      {
+        progressiveSettings.samples = std::stoi(argv[++i]);
+      }
+      else if (arg == "--preview-interval" && i + 1 < argc)
+      {
+        progressiveSettings.previewInterval = std::stod(argv[++i]);
+      }
+      else if (arg == "--preview" && i + 1 < argc)
+      {
+        previewPath = argv[++i];
+      }
+      else if (arg == "--region" && i + 1 < argc)
+      {
+        hasRegion = true;
+        region = ImageRegion::parse(argv[++i]);
+      }
+      else if (arg == "--tiles" && i + 1 < argc)
+      {
+        tileProcesses = std::stoi(argv[++i]);
+      }
+      else if (arg == "--workers" && i + 1 < argc)
+      {
+        std::string list = argv[++i];
+        size_t start = 0, end;
+        while ((end = list.find(',', start)) != std::string::npos)
+        {
+          workers.push_back(list.substr(start, end - start));
+          start = end + 1;
+        }
+        workers.push_back(list.substr(start));
+      }
+      else if (arg == "--time-budget" && i + 1 < argc)
+      {
+        timeBudget = std::stod(argv[++i]);
+      }
+      else if (arg == "--max-time" && i + 1 < argc)
+      {
+        progressiveSettings.maxTime = std::stod(argv[++i]);
+      }
+      else
+      {
+        throw std::invalid_argument("Unknown option: " + arg);
+      }
+    }
+  }
+  catch (std::exception const &e)
+  {
+    std::cerr << "[ERROR] " << e.what() << std::endl;
+    return 1;
+  }
+
+  Scene *scene;
+  Camera *camera;
+  Image *image;
+  try
+  {
+    std::tie(scene, camera, image) = SceneLoader::Load(path);
+  }
+  catch (std::exception const &e)
   {
-    outpath = argv[2];
+    std::cerr << "[ERROR] " << e.what() << std::endl;
+    return 1;
+  }
+  // No other scene will be loaded: the meshes have their own copy of the triangles
+  ObjCache::shared().clear();
+
+  if (hasRegion)
+  {
+    if (region.x1 > image->width || region.y1 > image->height)
+    {
+      std::cerr << "[ERROR] The region is outside of the " << image->width << "x" << image->height << " image" << std::endl;
+      return 1;
+    }
+    // Only the tile is rendered and written, with the camera of the full frame
+    Image *tile = new Image(region.width(), region.height());
+    std::cout << "Rendering region " << region.x0 << "," << region.y0 << " " << tile->width << "x" << tile->height
+              << " of " << image->width << "x" << image->height << " pixels..." << std::endl;
+
+    auto begin = std::chrono::high_resolution_clock::now();
+    camera->renderRegion(*tile, *scene, image->width, image->height, region.x0, region.y0);
+    auto end = std::chrono::high_resolution_clock::now();
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin);
+    std::printf("Total time: %.3f seconds.\n", elapsed.count() * 1e-9);
+
+    std::cout << "Writing file: " << outpath << std::endl;
+    tile->writeFile(outpath, png);
+    delete tile;
+    delete scene;
+    delete camera;
+    delete image;
+    return 0;
+  }
+
+  if (tileProcesses > 0 || !workers.empty())
+  {
+    std::string executable = std::filesystem::exists("/proc/self/exe") ? "/proc/self/exe" : argv[0];
+    TileCoordinator coordinator(path, executable);
+
+    std::cout << "Rendering " << image->width << "x" << image->height << " pixels with "
+              << (workers.empty() ? tileProcesses : workers.size()) << " workers..." << std::endl;
+
+    auto begin = std::chrono::high_resolution_clock::now();
+    bool ok = workers.empty() ? coordinator.renderWithProcesses(*image, tileProcesses)
+                              : coordinator.renderWithServers(*image, workers);
+    auto end = std::chrono::high_resolution_clock::now();
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin);
+    std::printf("Total time: %.3f seconds.\n", elapsed.count() * 1e-9);
+
+    if (ok)
+    {
+      std::cout << "Writing file: " << outpath << std::endl;
+      image->writeFile(outpath, png);
+    }
+    delete scene;
+    delete camera;
+    delete image;
+    return ok ? 0 : 1;
   }
 
   std::cout << "Rendering " << image->width << "x" << image->height << " pixels..." << std::endl;
 
   auto begin = std::chrono::high_resolution_clock::now();
-  camera->render(*image, *scene);
+  if (progressive || timeBudget > 0)
+  {
+    if (previewPath.empty())
+    {
+      std::filesystem::path out = outpath;
+      previewPath = (out.parent_path() / (out.stem().string() + ".preview" + out.extension().string())).string();
+    }
+    progressiveSettings.preview = [previewPath, png](Image &preview) mutable
+    {
+      std::cout << "Writing preview: " << previewPath << std::endl;
+      preview.writeFile(previewPath, png);
+    };
+
+    // Ctrl+C stops the render and keeps the image so far
+    progressiveSettings.cancel = &interrupted;
+    std::signal(SIGINT, onInterrupt);
+
+    if (timeBudget > 0)
+    {
+      RenderQuality quality = camera->renderBudgeted(*image, *scene, timeBudget, progressiveSettings);
+      std::cout << "Samples per pixel: " << quality.samples << ", reflections: " << quality.reflections << std::endl;
+    }
+    else
+    {
+      int samples = camera->renderProgressive(*image, *scene, progressiveSettings);
+      std::cout << "Samples per pixel: " << samples << std::endl;
+    }
+  }
+  else
+  {
+    camera->render(*image, *scene);
+  }
   auto end = std::chrono::high_resolution_clock::now();
   auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin);
 
@@ -37,7 +319,7 @@ int main(int argc, char *argv[])
   std::printf("Total time: %.3f seconds.\n", elapsed.count() * 1e-9);
 
   std::cout << "Writing file: " << outpath << std::endl;
-  image->writeFile(outpath);
+  image->writeFile(outpath, png);
 
   delete scene;
   delete camera;
@@ -1,8 +1,23 @@
 #include <iostream>
 #include <cmath>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <filesystem>
+#include <fstream>
 #include "Image.hpp"
 #include "../lodepng/lodepng.h"
 
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#include <atomic>
+#include <cstring>
+#include <future>
+#include "ThreadPool.hpp"
+#endif
+
 
 Image:: Image(unsigned int w, unsigned int h) : width(w), height(h)
 {  
@@ -40,22 +55,325 @@ Color Image::getPixel(unsigned int x, unsigned int y) {
 }
 
 
-void Image::writeFile(std::string& filename) {
+ImageRegion ImageRegion::parse(std::string const &text)
+{
+  ImageRegion region;
+  char end;
+  if (std::sscanf(text.c_str(), "%u,%u,%u,%u%c", &region.x0, &region.y0, &region.x1, &region.y1, &end) != 4 ||
+      region.x1 <= region.x0 || region.y1 <= region.y0)
+  {
+    throw std::invalid_argument("Invalid region (expected x0,y0,x1,y1): " + text);
+  }
+  return region;
+}
+
+Image *Image::readRaw(std::string const &filename, unsigned int w, unsigned int h) {
+  std::ifstream file(filename, std::ios::binary);
+  Image *image = new Image(w, h);
+  file.read((char *)image->buffer.data(), image->buffer.size() * sizeof(Color));
+  if (!file.good()) {
+    delete image;
+    return NULL;
+  }
+  return image;
+}
+
+std::string Image::toRaw() const {
+  return std::string((const char *)buffer.data(), buffer.size() * sizeof(Color));
+}
+
+Image *Image::fromRaw(std::string const &data, unsigned int w, unsigned int h) {
+  Image *image = new Image(w, h);
+  if (data.size() != image->buffer.size() * sizeof(Color)) {
+    delete image;
+    return NULL;
+  }
+  std::memcpy((char *)image->buffer.data(), data.data(), data.size());
+  return image;
+}
+
+void Image::paste(Image const &tile, unsigned int x0, unsigned int y0) {
+  if (x0 + tile.width > width || y0 + tile.height > height) { throw std::invalid_argument("Image: Invalid tile position"); }
+  for (unsigned int y = 0; y < tile.height; ++y) {
+    std::copy(tile.buffer.begin() + y * tile.width, tile.buffer.begin() + (y + 1) * tile.width,
+              buffer.begin() + (y0 + y) * width + x0);
+  }
+}
+
+PngFilter PngSettings::parseFilter(std::string const &name)
+{
+  if (name == "none") return PNG_FILTER_NONE;
+  if (name == "sub") return PNG_FILTER_SUB;
+  if (name == "paeth") return PNG_FILTER_PAETH;
+  if (name == "minsum") return PNG_FILTER_MINSUM;
+  if (name == "entropy") return PNG_FILTER_ENTROPY;
+  throw std::invalid_argument("Unknown PNG filter: " + name);
+}
+
+#ifdef HAVE_ZLIB
+
+struct ZlibContext
+{
+  int level;
+  unsigned int threads;
+  size_t rowSize;
+};
+
+/**
+ * Deflates one chunk of rows as a raw deflate stream.
+ * Every chunk but the last ends with a sync flush (byte aligned, not final), so that the
+ * chunks can simply be concatenated. The 32KB preceding the chunk are used as dictionary,
+ * which keeps the compression ratio close to a single stream (same technique as pigz).
+ */
+static bool deflateChunk(const ZlibContext *context, const unsigned char *in, size_t begin, size_t end, bool last,
+                         std::vector<unsigned char> &out)
+{
+  z_stream stream;
+  std::memset(&stream, 0, sizeof(stream));
+  if (deflateInit2(&stream, context->level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+  {
+    return false;
+  }
+
+  if (begin > 0)
+  {
+    size_t dictionaryStart = begin > 32768 ? begin - 32768 : 0;
+    deflateSetDictionary(&stream, in + dictionaryStart, begin - dictionaryStart);
+  }
+
+  out.resize(deflateBound(&stream, end - begin) + 16);
+  stream.next_in = (Bytef *)(in + begin);
+  stream.avail_in = end - begin;
+
+  int flush = last ? Z_FINISH : Z_SYNC_FLUSH;
+  int result;
+  do
+  {
+    if (stream.total_out == out.size())
+    {
+      out.resize(out.size() * 2);
+    }
+    stream.next_out = out.data() + stream.total_out;
+    stream.avail_out = out.size() - stream.total_out;
+    result = deflate(&stream, flush);
+  } while (result == Z_OK && (stream.avail_in > 0 || stream.avail_out == 0 || last));
+
+  out.resize(stream.total_out);
+  deflateEnd(&stream);
+  return last ? result == Z_STREAM_END : result == Z_OK || result == Z_BUF_ERROR;
+}
+
+/**
+ * Custom zlib compressor for lodepng: the filtered rows are split in chunks deflated in parallel.
+ */
+static unsigned parallelZlibCompress(unsigned char **out, size_t *outsize, const unsigned char *in, size_t insize,
+                                     const LodePNGCompressSettings *settings)
+{
+  const ZlibContext *context = (const ZlibContext *)settings->custom_context;
+
+  // Chunks of whole rows, big enough for the dictionary trick to pay off
+  size_t rowsPerChunk = std::max((size_t)1, (size_t)(256 * 1024) / context->rowSize);
+  size_t chunkSize = rowsPerChunk * context->rowSize;
+  size_t chunkCount = std::max((size_t)1, (insize + chunkSize - 1) / chunkSize);
+
+  std::vector<std::vector<unsigned char>> chunks(chunkCount);
+  std::vector<uLong> checksums(chunkCount);
+  std::atomic<size_t> nextChunk(0);
+  std::atomic<bool> failed(false);
+
+  auto worker = [&]()
+  {
+    size_t k;
+    while ((k = nextChunk++) < chunkCount)
+    {
+      size_t begin = k * chunkSize;
+      size_t end = std::min(insize, begin + chunkSize);
+      if (!deflateChunk(context, in, begin, end, k == chunkCount - 1, chunks[k]))
+      {
+        failed = true;
+      }
+      checksums[k] = adler32(adler32(0L, Z_NULL, 0), in + begin, end - begin);
+    }
+  };
+
+  // Workers on the shared pool, so that encoding next to a render does not add threads
+  ThreadPool &pool = ThreadPool::shared();
+  unsigned int threadCount = std::min((size_t)context->threads, chunkCount);
+  std::vector<std::future<void>> workers;
+  for (unsigned int i = 1; i < threadCount; ++i)
+  {
+    workers.push_back(pool.submit(worker));
+  }
+  worker();
+  for (auto &w : workers)
+  {
+    pool.wait(w);
+  }
+
+  if (failed)
+  {
+    return 111;
+  }
+
+  uLong checksum = checksums[0];
+  size_t total = 2 + 4 + chunks[0].size();
+  for (size_t k = 1; k < chunkCount; ++k)
+  {
+    size_t length = std::min(insize, (k + 1) * chunkSize) - k * chunkSize;
+    checksum = adler32_combine(checksum, checksums[k], length);
+    total += chunks[k].size();
+  }
+
+  unsigned char *data = (unsigned char *)malloc(total);
+  if (data == NULL)
+  {
+    return 83; // lodepng "memory allocation failed"
+  }
+
+  // zlib header: deflate with a 32K window, and the compression level as a hint
+  unsigned int cmf = 0x78;
+  unsigned int flevel = context->level < 2 ? 0 : context->level < 6 ? 1 : context->level == 6 ? 2 : 3;
+  unsigned int flg = flevel << 6;
+  flg += 31 - ((cmf * 256 + flg) % 31);
+  data[0] = cmf;
+  data[1] = flg;
+
+  size_t pos = 2;
+  for (auto &chunk : chunks)
+  {
+    std::memcpy(data + pos, chunk.data(), chunk.size());
+    pos += chunk.size();
+  }
+
+  data[pos++] = (checksum >> 24) & 0xff;
+  data[pos++] = (checksum >> 16) & 0xff;
+  data[pos++] = (checksum >> 8) & 0xff;
+  data[pos++] = checksum & 0xff;
+
+  *out = data;
+  *outsize = total;
+  return 0;
+}
+
+#endif
+
+void Image::writeFile(std::string& filename, PngSettings const &settings) {
+  std::string extension = std::filesystem::path(filename).extension().string();
+  std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+
+  if (extension == ".ppm") {
+    writePpm(filename);
+  } else if (extension == ".pfm") {
+    writePfm(filename);
+  } else if (extension == ".raw") {
+    writeRaw(filename);
+  } else {
+    writePng(filename, settings);
+  }
+}
+
+/**
+ * The uncompressed writers stream straight from the framebuffer:
+ * Color is three packed floats, so float rows are written as they are in memory.
+ */
+void Image::writePpm(std::string& filename) {
+  std::ofstream file(filename, std::ios::binary);
+  file << "P6\n" << width << " " << height << "\n255\n";
+
+  std::vector<unsigned char> row(width * 3);
+  for (unsigned int y = 0; y < height; ++y) {
+    const Color *pixels = &buffer[y * width];
+    for (unsigned int x = 0; x < width; ++x) {
+      row[x * 3] = (unsigned int)floor(pixels[x].r * 255);
+      row[x * 3 + 1] = (unsigned int)floor(pixels[x].g * 255);
+      row[x * 3 + 2] = (unsigned int)floor(pixels[x].b * 255);
+    }
+    file.write((const char *)row.data(), row.size());
+  }
+
+  if (!file.good()) std::cout << "could not write " << filename << std::endl;
+}
+
+void Image::writePfm(std::string& filename) {
+  std::ofstream file(filename, std::ios::binary);
+
+  // A negative scale means little endian floats
+  const uint16_t one = 1;
+  bool littleEndian = *(const unsigned char *)&one == 1;
+  file << "PF\n" << width << " " << height << "\n" << (littleEndian ? "-1.0" : "1.0") << "\n";
+
+  // PFM rows go from the bottom to the top of the image
+  for (unsigned int y = height; y-- > 0;) {
+    file.write((const char *)&buffer[y * width], width * sizeof(Color));
+  }
+
+  if (!file.good()) std::cout << "could not write " << filename << std::endl;
+}
+
+void Image::writeRaw(std::string& filename) {
+  std::ofstream file(filename, std::ios::binary);
+  file.write((const char *)buffer.data(), buffer.size() * sizeof(Color));
+
+  if (!file.good()) std::cout << "could not write " << filename << std::endl;
+}
+
+void Image::writePng(std::string& filename, PngSettings const &settings) {
+  // 8 bits RGB: the alpha channel would always be opaque
   std::vector<unsigned char> image;
-  image.resize(width * height * 4);
+  image.resize(width * height * 3);
   for(unsigned index = 0; index < buffer.size(); index++) {
     Color pixel = buffer[index];
-    int offset = index * 4;
+    int offset = index * 3;
 
     image[offset] = (unsigned int)floor(pixel.r * 255); 
     image[offset + 1] = (unsigned int)floor(pixel.g * 255); 
     image[offset + 2] = (unsigned int)floor(pixel.b * 255); 
-    image[offset + 3] = 255;      // Alpha
   }
 
+  lodepng::State state;
+  state.info_raw.colortype = LCT_RGB;
+  state.info_raw.bitdepth = 8;
+  state.info_png.color.colortype = LCT_RGB;
+  state.info_png.color.bitdepth = 8;
+  state.encoder.auto_convert = 0;
+
+  switch (settings.filter)
+  {
+  case PNG_FILTER_NONE: state.encoder.filter_strategy = LFS_ZERO; break;
+  case PNG_FILTER_SUB: state.encoder.filter_strategy = LFS_ONE; break;
+  case PNG_FILTER_PAETH: state.encoder.filter_strategy = LFS_FOUR; break;
+  case PNG_FILTER_MINSUM: state.encoder.filter_strategy = LFS_MINSUM; break;
+  case PNG_FILTER_ENTROPY: state.encoder.filter_strategy = LFS_ENTROPY; break;
+  }
+
+  int level = std::max(0, std::min(settings.level, 9));
+
+#ifdef HAVE_ZLIB
+  ZlibContext context;
+  context.level = level;
+  context.threads = settings.threads > 0 ? settings.threads : ThreadPool::shared().size() + 1;
+  context.rowSize = 1 + width * 3; // filter type byte + RGB row
+  state.encoder.zlibsettings.custom_zlib = parallelZlibCompress;
+  state.encoder.zlibsettings.custom_context = &context;
+#else
+  // Built-in (single-threaded) deflate of lodepng
+  if (level == 0)
+  {
+    state.encoder.zlibsettings.btype = 0;
+  }
+  else
+  {
+    state.encoder.zlibsettings.windowsize = level <= 3 ? 1024 : level <= 6 ? 2048 : 32768;
+    state.encoder.zlibsettings.lazymatching = level > 3;
+    state.encoder.zlibsettings.nicematch = level >= 7 ? 258 : 128;
+  }
+#endif
+
   //Encode the image
-  unsigned error = lodepng::encode(filename, image, width, height);
+  std::vector<unsigned char> png;
+  unsigned error = lodepng::encode(png, image, width, height, state);
+  if (!error) error = lodepng::save_file(png, filename);
 
   //if there's an error, display it
   if(error) std::cout << "encoder error " << error << ": "<< lodepng_error_text(error) << std::endl;
-}
\ No newline at end of file
+}
@@ -4,10 +4,55 @@
 #include "../raymath/Color.hpp"
 #include <vector>
 
+enum PngFilter
+{
+  PNG_FILTER_NONE,    // No filtering, fastest
+  PNG_FILTER_SUB,     // Same filter (sub) on every row
+  PNG_FILTER_PAETH,   // Same filter (paeth) on every row
+  PNG_FILTER_MINSUM,  // Best filter per row, minimum sum heuristic (lodepng default)
+  PNG_FILTER_ENTROPY  // Best filter per row, minimum entropy heuristic
+};
+
+/**
+ * Settings of the PNG encoder.
+ */
+struct PngSettings
+{
+  // 0 = store (no compression, for intermediate frames), 1 = fastest ... 9 = smallest
+  int level = 6;
+  PngFilter filter = PNG_FILTER_MINSUM;
+  // Threads used to deflate independent chunks of rows, on the shared pool (0 = all of its workers and the caller)
+  unsigned int threads = 0;
+
+  /**
+   * Parses a filter name (none, sub, paeth, minsum, entropy). Throws std::invalid_argument.
+   */
+  static PngFilter parseFilter(std::string const &name);
+};
+
+/**
+ * Rectangle of pixels [x0, x1[ x [y0, y1[
+ */
+struct ImageRegion
+{
+  unsigned int x0 = 0;
+  unsigned int y0 = 0;
+  unsigned int x1 = 0;
+  unsigned int y1 = 0;
+
+  unsigned int width() const { return x1 - x0; }
+  unsigned int height() const { return y1 - y0; }
+
+  /**
+   * Parses "x0,y0,x1,y1". Throws std::invalid_argument.
+   */
+  static ImageRegion parse(std::string const &text);
+};
+
 class Image
 {
 private:
-  
+
   std::vector<Color> buffer;
 public:
   Image(unsigned int w, unsigned int h);
@@ -20,5 +65,29 @@ public:
   void setPixel(unsigned int x, unsigned int y, Color color);
   Color getPixel(unsigned int x, unsigned int y);
 
-  void writeFile(std::string& filename);
+  /**
+   * Writes the image, the format is chosen from the extension of the file:
+   * .ppm (binary 8 bits), .pfm (float HDR), .raw (float32 RGB dump, top to bottom rows), PNG otherwise.
+   */
+  void writeFile(std::string& filename, PngSettings const &settings = PngSettings());
+
+  /**
+   * Reads a file written by writeRaw. Returns NULL if the file is missing or too small.
+   */
+  static Image *readRaw(std::string const &filename, unsigned int w, unsigned int h);
+
+  /**
+   * Pixels in the format of writeRaw, and back (NULL if data does not have the size of a w x h image).
+   */
+  std::string toRaw() const;
+  static Image *fromRaw(std::string const &data, unsigned int w, unsigned int h);
+
+  /**
+   * Copies a tile into this image, with (x0, y0) the top left corner of the tile.
+   */
+  void paste(Image const &tile, unsigned int x0, unsigned int y0);
+  void writePng(std::string& filename, PngSettings const &settings);
+  void writePpm(std::string& filename);
+  void writePfm(std::string& filename);
+  void writeRaw(std::string& filename);
 };
@@ -1,7 +1,7 @@
 #include <iostream>
 #include "Color.hpp"
 
-Color::Color() : r(0), b(0), g(0)
+Color::Color() : r(0), g(0), b(0)
 {
 }
 
@@ -18,7 +18,7 @@ Color::~Color()
  * Adding two colors is done by just adding the different components together :
  * (r1, g1, b1) + (r2, g2, b2) = (r1 + r2, g1 + g2, b1 + b2)
  */
-Color Color::operator+(Color const &col)
+Color Color::operator+(Color const &col) const
 {
   Color c;
   c.r = std::max(std::min(r + col.r, 1.0f), 0.0f);
@@ -35,7 +35,7 @@ Color &Color::operator=(Color const &col)
   return *this;
 }
 
-Color Color::operator*(float const &f)
+Color Color::operator*(float const &f) const
 {
   Color c;
   c.r = std::max(std::min(r * f, 1.0f), 0.0f);
@@ -44,7 +44,7 @@ Color Color::operator*(float const &f)
   return c;
 }
 
-Color Color::operator*(Color const &col)
+Color Color::operator*(Color const &col) const
 {
   Color c;
   c.r = std::max(std::min(r * col.r, 1.0f), 0.0f);
@@ -53,7 +53,7 @@ Color Color::operator*(Color const &col)
   return c;
 }
 
-Color Color::operator/(float const &f)
+Color Color::operator/(float const &f) const
 {
   Color c;
   c.r = std::max(std::min(r / f, 1.0f), 0.0f);
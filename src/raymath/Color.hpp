@@ -9,14 +9,17 @@ public:
   Color(float r, float g, float b);
   ~Color();
 
+  // Kept in RGB order: an image buffer can be written as float triplets without conversion
   float r = 0;
-  float b = 0;
   float g = 0;
+  float b = 0;
 
-  Color operator+(Color const &col);
+  Color operator+(Color const &col) const;
   Color &operator=(Color const &col);
-  Color operator*(float const &f);
-  Color operator*(Color const &col);
-  Color operator/(float const &f);
+  Color operator*(float const &f) const;
+  Color operator*(Color const &col) const;
+  Color operator/(float const &f) const;
   friend std::ostream &operator<<(std::ostream &_stream, Color const &col);
 };
+
+static_assert(sizeof(Color) == 3 * sizeof(float), "Color must be three packed floats");
@@ -11,6 +11,11 @@ Ray::Ray(Vector3 pos, Vector3 dir) : position(pos)
   direction = dir.normalize();
 }
 
+Ray::Ray(Vector3 pos, Vector3 dir, bool normalized) : position(pos)
+{
+  direction = normalized ? dir : dir.normalize();
+}
+
 Ray::~Ray()
 {
 }
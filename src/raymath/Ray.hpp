@@ -12,6 +12,8 @@ private:
 public:
   Ray();
   Ray(Vector3 pos, Vector3 dir);
+  // normalized: dir is already a unit vector, kept as is
+  Ray(Vector3 pos, Vector3 dir, bool normalized);
   ~Ray();
 
   Vector3 GetPosition();
@@ -0,0 +1,45 @@
+#include <cstdlib>
+#include "Arena.hpp"
+
+Arena::~Arena()
+{
+  // Reverse order of creation, like the destruction of local variables
+  for (size_t i = cleanups.size(); i-- > 0;)
+  {
+    cleanups[i].destroy(cleanups[i].objects, cleanups[i].count);
+  }
+  for (Block &block : blocks)
+  {
+    std::free(block.data);
+  }
+}
+
+void *Arena::allocate(size_t size, size_t alignment)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  return allocateLocked(size, alignment);
+}
+
+void *Arena::allocateLocked(size_t size, size_t alignment)
+{
+  size_t padding = (alignment - reinterpret_cast<size_t>(current) % alignment) % alignment;
+  if (current == nullptr || padding + size > remaining)
+  {
+    // Large arrays (mesh triangles) get a block of their own
+    size_t blockSize = size + alignment > BLOCK_SIZE ? size + alignment : BLOCK_SIZE;
+    char *data = static_cast<char *>(std::malloc(blockSize));
+    if (data == nullptr)
+    {
+      throw std::bad_alloc();
+    }
+    blocks.push_back({data, blockSize});
+    current = data;
+    remaining = blockSize;
+    padding = (alignment - reinterpret_cast<size_t>(current) % alignment) % alignment;
+  }
+
+  char *result = current + padding;
+  current += padding + size;
+  remaining -= padding + size;
+  return result;
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstddef>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * Monotonic allocator owning all the data of a scene (objects, mesh triangles, lights, materials).
+ * Allocating is a pointer bump in the current block, objects created one after the other sit
+ * contiguously in memory, and nothing is freed before the whole arena is destroyed.
+ * Allocation is thread-safe (meshes are loaded in parallel).
+ */
+class Arena
+{
+private:
+  struct Block
+  {
+    char *data;
+    size_t size;
+  };
+
+  /**
+   * Destructor to run on count consecutive objects, when the arena is destroyed
+   */
+  struct Cleanup
+  {
+    void *objects;
+    size_t count;
+    void (*destroy)(void *objects, size_t count);
+  };
+
+  static const size_t BLOCK_SIZE = 64 * 1024;
+
+  std::mutex mutex;
+  std::vector<Block> blocks;
+  std::vector<Cleanup> cleanups;
+  char *current = nullptr;
+  size_t remaining = 0;
+
+  void *allocateLocked(size_t size, size_t alignment);
+
+  template <typename T>
+  static void destroy(void *objects, size_t count)
+  {
+    T *typed = static_cast<T *>(objects);
+    for (size_t i = 0; i < count; ++i)
+    {
+      typed[i].~T();
+    }
+  }
+
+  template <typename T>
+  void registerCleanup(T *objects, size_t count)
+  {
+    if (!std::is_trivially_destructible<T>::value)
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      cleanups.push_back({objects, count, &Arena::destroy<T>});
+    }
+  }
+
+public:
+  Arena() = default;
+  Arena(Arena const &) = delete;
+  Arena &operator=(Arena const &) = delete;
+  ~Arena();
+
+  /**
+   * Uninitialized memory, valid until the arena is destroyed.
+   */
+  void *allocate(size_t size, size_t alignment);
+
+  /**
+   * Constructs an object in the arena. Its destructor runs when the arena is destroyed.
+   */
+  template <typename T, typename... Args>
+  T *create(Args &&...args)
+  {
+    T *object = new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    registerCleanup(object, 1);
+    return object;
+  }
+
+  /**
+   * Constructs count consecutive objects, the i-th one being make(i, memory of the object).
+   * Only one allocation and one cleanup entry for the whole array.
+   */
+  template <typename T, typename F>
+  T *createArray(size_t count, F make)
+  {
+    if (count == 0)
+    {
+      return nullptr;
+    }
+    T *objects = static_cast<T *>(allocate(sizeof(T) * count, alignof(T)));
+    for (size_t i = 0; i < count; ++i)
+    {
+      make(i, objects + i);
+    }
+    registerCleanup(objects, count);
+    return objects;
+  }
+};
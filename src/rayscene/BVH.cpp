@@ -0,0 +1,1207 @@
+#include <algorithm>
+#include <cmath>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <future>
+#include <limits>
+#include "BVH.hpp"
+#include "ThreadPool.hpp"
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/**
+ * Node of the binary tree, before the collapse into wide nodes
+ */
+struct BVHBuildNode
+{
+  Bounds box;
+  // -1 for a leaf
+  int left = -1;
+  int right = -1;
+  int first = 0;
+  int count = 0;
+};
+
+// Nodes with more primitives than this are measured and binned by several tasks...
+static const int PARALLEL_BINNING = 1 << 16;
+// ...and their subtrees built as separate tasks
+static const int PARALLEL_SUBTREE = 1 << 12;
+
+static int chunkCount(int count)
+{
+  return count < PARALLEL_BINNING ? 1 : (int)ThreadPool::shared().size();
+}
+
+/**
+ * Runs work(chunk, begin, end) on each of the chunks of [first, first + count[,
+ * the first one on the calling thread and the others on the shared pool.
+ */
+template <typename Work>
+static void forChunks(int first, int count, int chunks, Work work)
+{
+  ThreadPool &pool = ThreadPool::shared();
+  std::vector<std::future<void>> tasks;
+  for (int c = 1; c < chunks; ++c)
+  {
+    int begin = first + (int)((long long)count * c / chunks);
+    int end = first + (int)((long long)count * (c + 1) / chunks);
+    tasks.push_back(pool.submit([&work, c, begin, end]()
+                                { work(c, begin, end); }));
+  }
+  work(0, first, first + (int)((long long)count / chunks));
+  for (auto &task : tasks)
+  {
+    pool.wait(task);
+    task.get();
+  }
+}
+
+static Vector3 centerOf(Bounds const &box)
+{
+  return Vector3(box.center(0), box.center(1), box.center(2));
+}
+
+/**
+ * 10 bits spread out to every third bit
+ */
+static uint32_t expandBits(uint32_t v)
+{
+  v = (v * 0x00010001u) & 0xFF0000FFu;
+  v = (v * 0x00000101u) & 0x0F00F00Fu;
+  v = (v * 0x00000011u) & 0xC30C30C3u;
+  v = (v * 0x00000005u) & 0x49249249u;
+  return v;
+}
+
+/**
+ * Morton code of a point of [0, 1]^3 (10 bits per axis)
+ */
+static uint32_t mortonCode(double x, double y, double z)
+{
+  uint32_t ix = (uint32_t)std::min(std::max(x * 1024, 0.0), 1023.0);
+  uint32_t iy = (uint32_t)std::min(std::max(y * 1024, 0.0), 1023.0);
+  uint32_t iz = (uint32_t)std::min(std::max(z * 1024, 0.0), 1023.0);
+  return (expandBits(ix) << 2) | (expandBits(iy) << 1) | expandBits(iz);
+}
+
+/**
+ * Bin of the SAH. With spatial splits, a reference spans several bins:
+ * it enters the side of the split holding its first bin, and exits on the side of its last one.
+ */
+struct BVHBin
+{
+  Bounds box;
+  int entries = 0;
+  int exits = 0;
+};
+
+/**
+ * Cheapest split of one axis, after one of its bins (cost = area * count on each side).
+ * Updates bestCost and bestBin when it beats bestCost.
+ */
+static bool sweepBins(BVHBin const *bins, double &bestCost, int &bestBin)
+{
+  double rightCost[BVH::SAH_BINS];
+  Bounds right;
+  int rightCount = 0;
+  for (int b = BVH::SAH_BINS - 1; b > 0; --b)
+  {
+    right.grow(bins[b].box);
+    rightCount += bins[b].exits;
+    rightCost[b] = rightCount > 0 ? right.area() * rightCount : -1;
+  }
+
+  bool found = false;
+  Bounds left;
+  int leftCount = 0;
+  for (int b = 0; b < BVH::SAH_BINS - 1; ++b)
+  {
+    left.grow(bins[b].box);
+    leftCount += bins[b].entries;
+    double cost = left.area() * leftCount + rightCost[b + 1];
+    if (leftCount > 0 && rightCost[b + 1] >= 0 && cost < bestCost)
+    {
+      bestCost = cost;
+      bestBin = b;
+      found = true;
+    }
+  }
+  return found;
+}
+
+/**
+ * Builds the binary tree. The nodes are taken from a shared counter (a tree over n primitives
+ * has at most 2n - 1 nodes), and each subtree works on its own range of order:
+ * subtrees are built by different tasks without any lock.
+ */
+struct BVHBuilder
+{
+  std::vector<Bounds> const &primitives;
+  std::vector<int> &order;
+  BVHBuild method;
+  std::vector<BVHBuildNode> nodes;
+  std::atomic<int> nodeCount{0};
+  // Morton codes of order[i] (LBVH only)
+  std::vector<uint32_t> codes;
+
+  BVHBuilder(std::vector<Bounds> const &primitives, std::vector<int> &order, BVHBuild method)
+      : primitives(primitives), order(order), method(method), nodes(2 * primitives.size() - 1)
+  {
+  }
+
+  void build()
+  {
+    if (method == BVH_BUILD_LBVH)
+    {
+      sortByMortonCode();
+    }
+    buildNode(nodeCount++, 0, primitives.size(), 0);
+  }
+
+  void buildNode(int index, int first, int count, int depth)
+  {
+    int split = 0;
+    if (count > 1)
+    {
+      split = method == BVH_BUILD_LBVH ? splitMorton(first, count, depth) : splitSah(first, count, depth);
+    }
+
+    BVHBuildNode &node = nodes[index];
+    if (split == 0)
+    {
+      node.first = first;
+      node.count = count;
+      for (int i = first; i < first + count; ++i)
+      {
+        node.box.grow(primitives[order[i]]);
+      }
+      return;
+    }
+
+    int left = nodeCount++;
+    int right = nodeCount++;
+    if (count >= PARALLEL_SUBTREE)
+    {
+      ThreadPool &pool = ThreadPool::shared();
+      std::future<void> task = pool.submit([this, left, first, split, depth]()
+                                           { buildNode(left, first, split, depth + 1); });
+      buildNode(right, first + split, count - split, depth + 1);
+      pool.wait(task);
+      task.get();
+    }
+    else
+    {
+      buildNode(left, first, split, depth + 1);
+      buildNode(right, first + split, count - split, depth + 1);
+    }
+
+    node.left = left;
+    node.right = right;
+    node.box = nodes[left].box;
+    node.box.grow(nodes[right].box);
+  }
+
+  /**
+   * Median of the largest extent of the centers
+   */
+  int splitMedian(int first, int count, Bounds const &centers)
+  {
+    int axis = 0;
+    for (int a = 1; a < 3; ++a)
+    {
+      if (centers.max[a] - centers.min[a] > centers.max[axis] - centers.min[axis])
+      {
+        axis = a;
+      }
+    }
+    std::vector<Bounds> const &boxes = primitives;
+    std::nth_element(order.begin() + first, order.begin() + first + count / 2, order.begin() + first + count,
+                     [&boxes, axis](int a, int b)
+                     { return boxes[a].center(axis) < boxes[b].center(axis); });
+    return count / 2;
+  }
+
+  /**
+   * Number of primitives of the left child with the binned SAH, 0 for a leaf.
+   * The cost of a leaf is its number of primitives, the cost of a split 1 + the primitives
+   * of each side weighted by the area ratio of its box.
+   */
+  int splitSah(int first, int count, int depth)
+  {
+    int chunks = chunkCount(count);
+
+    std::vector<Bounds> boxes(chunks);
+    std::vector<Bounds> centers(chunks);
+    forChunks(first, count, chunks, [this, &boxes, &centers](int c, int begin, int end)
+              {
+                for (int i = begin; i < end; ++i)
+                {
+                  boxes[c].grow(primitives[order[i]]);
+                  centers[c].grow(centerOf(primitives[order[i]]));
+                }
+              });
+    for (int c = 1; c < chunks; ++c)
+    {
+      boxes[0].grow(boxes[c]);
+      centers[0].grow(centers[c]);
+    }
+    Bounds const &box = boxes[0];
+    Bounds const &center = centers[0];
+
+    if (depth >= BVH::SAH_DEPTH)
+    {
+      return count <= BVH::MAX_LEAF ? 0 : splitMedian(first, count, center);
+    }
+
+    double scale[3];
+    for (int axis = 0; axis < 3; ++axis)
+    {
+      double extent = center.max[axis] - center.min[axis];
+      scale[axis] = extent > 0 ? BVH::SAH_BINS / extent : 0;
+    }
+    auto binOf = [&center, &scale](Bounds const &primitive, int axis)
+    {
+      return std::min(BVH::SAH_BINS - 1, (int)((primitive.center(axis) - center.min[axis]) * scale[axis]));
+    };
+
+    std::vector<BVHBin> bins(chunks * 3 * BVH::SAH_BINS);
+    forChunks(first, count, chunks, [this, &bins, &scale, &binOf](int c, int begin, int end)
+              {
+                BVHBin *chunkBins = &bins[c * 3 * BVH::SAH_BINS];
+                for (int i = begin; i < end; ++i)
+                {
+                  Bounds const &primitive = primitives[order[i]];
+                  for (int axis = 0; axis < 3; ++axis)
+                  {
+                    if (scale[axis] > 0)
+                    {
+                      BVHBin &bin = chunkBins[axis * BVH::SAH_BINS + binOf(primitive, axis)];
+                      bin.box.grow(primitive);
+                      bin.entries++;
+                      bin.exits++;
+                    }
+                  }
+                }
+              });
+    for (int c = 1; c < chunks; ++c)
+    {
+      for (int b = 0; b < 3 * BVH::SAH_BINS; ++b)
+      {
+        bins[b].box.grow(bins[c * 3 * BVH::SAH_BINS + b].box);
+        bins[b].entries += bins[c * 3 * BVH::SAH_BINS + b].entries;
+        bins[b].exits += bins[c * 3 * BVH::SAH_BINS + b].exits;
+      }
+    }
+
+    // Split after bin bestBin of bestAxis
+    double bestCost = std::numeric_limits<double>::max();
+    int bestAxis = -1;
+    int bestBin = 0;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+      if (scale[axis] == 0)
+      {
+        continue;
+      }
+      if (sweepBins(&bins[axis * BVH::SAH_BINS], bestCost, bestBin))
+      {
+        bestAxis = axis;
+      }
+    }
+
+    if (bestAxis < 0)
+    {
+      // All the centers at the same place
+      return count <= BVH::MAX_LEAF ? 0 : splitMedian(first, count, center);
+    }
+    double area = box.area();
+    bestCost = area > 0 ? 1 + bestCost / area : count;
+    if (count <= BVH::MAX_LEAF && bestCost >= count)
+    {
+      return 0;
+    }
+
+    int axis = bestAxis;
+    auto middle = std::partition(order.begin() + first, order.begin() + first + count, [this, axis, bestBin, &binOf](int p)
+                                 { return binOf(primitives[p], axis) <= bestBin; });
+    return middle - (order.begin() + first);
+  }
+
+  /**
+   * Sorts order along the Morton curve of the centers (in their bounding box)
+   */
+  void sortByMortonCode()
+  {
+    int count = primitives.size();
+    int chunks = chunkCount(count);
+
+    std::vector<Bounds> centers(chunks);
+    forChunks(0, count, chunks, [this, &centers](int c, int begin, int end)
+              {
+                for (int i = begin; i < end; ++i)
+                {
+                  centers[c].grow(centerOf(primitives[i]));
+                }
+              });
+    for (int c = 1; c < chunks; ++c)
+    {
+      centers[0].grow(centers[c]);
+    }
+    Bounds const &center = centers[0];
+    double scale[3];
+    for (int axis = 0; axis < 3; ++axis)
+    {
+      double extent = center.max[axis] - center.min[axis];
+      scale[axis] = extent > 0 ? 1 / extent : 0;
+    }
+
+    // Code in the high bits, index in the low bits: equal codes keep the original order
+    std::vector<uint64_t> keys(count);
+    forChunks(0, count, chunks, [this, &keys, &center, &scale](int c, int begin, int end)
+              {
+                for (int i = begin; i < end; ++i)
+                {
+                  Bounds const &primitive = primitives[i];
+                  uint32_t code = mortonCode((primitive.center(0) - center.min[0]) * scale[0],
+                                             (primitive.center(1) - center.min[1]) * scale[1],
+                                             (primitive.center(2) - center.min[2]) * scale[2]);
+                  keys[i] = ((uint64_t)code << 32) | (uint32_t)i;
+                }
+              });
+    std::sort(keys.begin(), keys.end());
+
+    codes.resize(count);
+    for (int i = 0; i < count; ++i)
+    {
+      order[i] = (int)(keys[i] & 0xffffffffu);
+      codes[i] = (uint32_t)(keys[i] >> 32);
+    }
+  }
+
+  /**
+   * Number of primitives of the left child with the LBVH, 0 for a leaf: the range is split
+   * where the highest bit that differs in its (sorted) codes changes.
+   */
+  int splitMorton(int first, int count, int depth)
+  {
+    if (count <= BVH::MAX_LEAF)
+    {
+      return 0;
+    }
+    uint32_t difference = codes[first] ^ codes[first + count - 1];
+    if (difference == 0 || depth >= BVH::SAH_DEPTH)
+    {
+      return count / 2;
+    }
+    int bit = 31;
+    while (((difference >> bit) & 1) == 0)
+    {
+      bit--;
+    }
+    auto middle = std::partition_point(codes.begin() + first, codes.begin() + first + count, [bit](uint32_t code)
+                                       { return ((code >> bit) & 1) == 0; });
+    return middle - (codes.begin() + first);
+  }
+};
+
+/**
+ * Part of a primitive referenced by a node of the SBVH: a spatial split divides a triangle
+ * between the two children, each with the bounds of its own part.
+ */
+struct BVHReference
+{
+  int primitive;
+  Bounds box;
+};
+
+static double axisOf(Vector3 const &v, int axis)
+{
+  return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+}
+
+/**
+ * Grows part with the section of a triangle (corners sorted on the axis) by the plane at position
+ */
+static void growSection(Bounds &part, Vector3 const *sorted, int axis, double position)
+{
+  double p0 = axisOf(sorted[0], axis);
+  double p1 = axisOf(sorted[1], axis);
+  double p2 = axisOf(sorted[2], axis);
+  if (p2 == p0)
+  {
+    // In the plane
+    part.grow(sorted[0]);
+    part.grow(sorted[1]);
+    part.grow(sorted[2]);
+    return;
+  }
+  part.grow(sorted[0] + (sorted[2] - sorted[0]) * ((position - p0) / (p2 - p0)));
+  if (position < p1 || (position == p1 && p1 > p0))
+  {
+    part.grow(sorted[0] + (sorted[1] - sorted[0]) * ((position - p0) / (p1 - p0)));
+  }
+  else if (p2 > p1)
+  {
+    part.grow(sorted[1] + (sorted[2] - sorted[1]) * ((position - p1) / (p2 - p1)));
+  }
+  else
+  {
+    part.grow(sorted[1]);
+  }
+}
+
+static void sortCorners(Vector3 const *corners, int axis, Vector3 *sorted)
+{
+  sorted[0] = corners[0];
+  sorted[1] = corners[1];
+  sorted[2] = corners[2];
+  if (axisOf(sorted[1], axis) < axisOf(sorted[0], axis))
+  {
+    std::swap(sorted[0], sorted[1]);
+  }
+  if (axisOf(sorted[2], axis) < axisOf(sorted[1], axis))
+  {
+    std::swap(sorted[1], sorted[2]);
+  }
+  if (axisOf(sorted[1], axis) < axisOf(sorted[0], axis))
+  {
+    std::swap(sorted[0], sorted[1]);
+  }
+}
+
+/**
+ * Bounds of the part of a triangle (corners sorted) between from and to on the axis, within limit:
+ * the sections at both ends, and the corner in between if any
+ */
+static Bounds slabPart(Vector3 const *sorted, int axis, double from, double to, Bounds const &fromSection,
+                       Bounds const &toSection, Bounds const &limit)
+{
+  Bounds part = fromSection;
+  part.grow(toSection);
+  double middle = axisOf(sorted[1], axis);
+  if (middle > from && middle < to)
+  {
+    part.grow(sorted[1]);
+  }
+  for (int i = 0; i < 3; ++i)
+  {
+    part.min[i] = std::max(part.min[i], limit.min[i]);
+    part.max[i] = std::min(part.max[i], limit.max[i]);
+  }
+  part.min[axis] = from;
+  part.max[axis] = to;
+  return part;
+}
+
+/**
+ * Bounds of the part of a triangle between low and high on the axis, within limit
+ */
+static Bounds clipTriangle(Vector3 const *corners, int axis, double low, double high, Bounds const &limit)
+{
+  Vector3 sorted[3];
+  sortCorners(corners, axis, sorted);
+  double from = std::max(std::max(low, limit.min[axis]), axisOf(sorted[0], axis));
+  double to = std::min(std::min(high, limit.max[axis]), axisOf(sorted[2], axis));
+  if (from > to)
+  {
+    return Bounds();
+  }
+  Bounds fromSection;
+  Bounds toSection;
+  growSection(fromSection, sorted, axis, from);
+  growSection(toSection, sorted, axis, to);
+  return slabPart(sorted, axis, from, to, fromSection, toSection, limit);
+}
+
+/**
+ * Adds the parts of a triangle to the spatial bins it crosses, from firstBin to lastBin
+ * (each section between two bins is computed once, for both)
+ */
+static void binTriangle(BVHBin *bins, Vector3 const *corners, int axis, Bounds const &box, double width,
+                        int firstBin, int lastBin, Bounds const &limit)
+{
+  Vector3 sorted[3];
+  sortCorners(corners, axis, sorted);
+  double start = std::max(limit.min[axis], axisOf(sorted[0], axis));
+  double end = std::min(limit.max[axis], axisOf(sorted[2], axis));
+
+  double from = std::max(box.min[axis] + firstBin * width, start);
+  Bounds fromSection;
+  growSection(fromSection, sorted, axis, from);
+  for (int b = firstBin; b <= lastBin; ++b)
+  {
+    double high = b == BVH::SAH_BINS - 1 ? box.max[axis] : box.min[axis] + (b + 1) * width;
+    double to = std::min(high, end);
+    if (to < from)
+    {
+      break;
+    }
+    Bounds toSection;
+    growSection(toSection, sorted, axis, to);
+    Bounds part = slabPart(sorted, axis, from, to, fromSection, toSection, limit);
+    if (!part.empty())
+    {
+      bins[b].box.grow(part);
+    }
+    from = to;
+    fromSection = toSection;
+  }
+}
+
+/**
+ * Children of the object split must overlap by more than this (relative to the area of the root)
+ * for spatial splits to be tried
+ */
+static const double SPATIAL_OVERLAP = 1e-5;
+
+/**
+ * Builds the binary tree of the SBVH, on the calling thread: each node chooses between
+ * the best object split (binned SAH on the centers of its references) and the best spatial
+ * split (bins of space, references clipped to each bin they cross), as long as the references
+ * added by spatial splits stay within the budget.
+ */
+struct SpatialBVHBuilder
+{
+  std::vector<Bounds> const &primitives;
+  std::vector<Vector3> const &corners;
+  std::vector<int> &order;
+  std::vector<BVHBuildNode> nodes;
+  long long referenceCount;
+  long long referenceLimit;
+  double rootArea = 0;
+
+  SpatialBVHBuilder(std::vector<Bounds> const &primitives, std::vector<Vector3> const &corners, std::vector<int> &order,
+                    double splitBudget)
+      : primitives(primitives), corners(corners), order(order), referenceCount(primitives.size()),
+        referenceLimit(primitives.size() + (long long)(std::max(splitBudget, 0.0) * primitives.size()))
+  {
+  }
+
+  void build()
+  {
+    std::vector<BVHReference> references(primitives.size());
+    Bounds root;
+    for (int i = 0; i < primitives.size(); ++i)
+    {
+      references[i] = {i, primitives[i]};
+      root.grow(primitives[i]);
+    }
+    rootArea = root.area();
+
+    order.clear();
+    nodes.push_back(BVHBuildNode());
+    buildNode(0, references, 0);
+  }
+
+  void buildNode(int index, std::vector<BVHReference> &references, int depth)
+  {
+    int count = references.size();
+    Bounds box;
+    Bounds center;
+    for (BVHReference const &reference : references)
+    {
+      box.grow(reference.box);
+      center.grow(centerOf(reference.box));
+    }
+
+    std::vector<BVHReference> left;
+    std::vector<BVHReference> right;
+    if (count > 1 && !split(references, box, center, depth, left, right))
+    {
+      if (count > BVH::MAX_LEAF)
+      {
+        splitMedian(references, center, left, right);
+      }
+    }
+
+    if (left.empty())
+    {
+      nodes[index].first = order.size();
+      nodes[index].count = count;
+      nodes[index].box = box;
+      for (BVHReference const &reference : references)
+      {
+        order.push_back(reference.primitive);
+      }
+      return;
+    }
+    std::vector<BVHReference>().swap(references);
+
+    int leftIndex = nodes.size();
+    nodes.push_back(BVHBuildNode());
+    int rightIndex = nodes.size();
+    nodes.push_back(BVHBuildNode());
+    buildNode(leftIndex, left, depth + 1);
+    buildNode(rightIndex, right, depth + 1);
+
+    nodes[index].left = leftIndex;
+    nodes[index].right = rightIndex;
+    nodes[index].box = nodes[leftIndex].box;
+    nodes[index].box.grow(nodes[rightIndex].box);
+  }
+
+  /**
+   * Divides the references with the cheapest split. Returns false to make a leaf instead.
+   */
+  bool split(std::vector<BVHReference> &references, Bounds const &box, Bounds const &center, int depth,
+             std::vector<BVHReference> &left, std::vector<BVHReference> &right)
+  {
+    if (depth >= BVH::SAH_DEPTH)
+    {
+      return false;
+    }
+    int count = references.size();
+
+    // Object split, on the centers
+    double objectCost = std::numeric_limits<double>::max();
+    int objectAxis = -1;
+    int objectBin = 0;
+    double objectScale[3];
+    BVHBin objectBins[3][BVH::SAH_BINS];
+    for (int axis = 0; axis < 3; ++axis)
+    {
+      double extent = center.max[axis] - center.min[axis];
+      objectScale[axis] = extent > 0 ? BVH::SAH_BINS / extent : 0;
+      if (objectScale[axis] == 0)
+      {
+        continue;
+      }
+      for (BVHReference const &reference : references)
+      {
+        int b = std::min(BVH::SAH_BINS - 1, (int)((reference.box.center(axis) - center.min[axis]) * objectScale[axis]));
+        objectBins[axis][b].box.grow(reference.box);
+        objectBins[axis][b].entries++;
+        objectBins[axis][b].exits++;
+      }
+      if (sweepBins(objectBins[axis], objectCost, objectBin))
+      {
+        objectAxis = axis;
+      }
+    }
+
+    // Spatial split, only when the children of the object split overlap
+    double overlap = 0;
+    if (objectAxis >= 0)
+    {
+      Bounds objectLeft;
+      Bounds objectRight;
+      for (int b = 0; b < BVH::SAH_BINS; ++b)
+      {
+        if (b <= objectBin)
+        {
+          objectLeft.grow(objectBins[objectAxis][b].box);
+        }
+        else
+        {
+          objectRight.grow(objectBins[objectAxis][b].box);
+        }
+      }
+      Bounds both;
+      for (int i = 0; i < 3; ++i)
+      {
+        both.min[i] = std::max(objectLeft.min[i], objectRight.min[i]);
+        both.max[i] = std::min(objectLeft.max[i], objectRight.max[i]);
+      }
+      overlap = both.empty() ? 0 : both.area();
+    }
+
+    double spatialCost = std::numeric_limits<double>::max();
+    int spatialAxis = -1;
+    int spatialBin = 0;
+    if (referenceCount < referenceLimit && (objectAxis < 0 || overlap > SPATIAL_OVERLAP * rootArea))
+    {
+      for (int axis = 0; axis < 3; ++axis)
+      {
+        double width = (box.max[axis] - box.min[axis]) / BVH::SAH_BINS;
+        if (!(width > 0))
+        {
+          continue;
+        }
+        BVHBin bins[BVH::SAH_BINS];
+        for (BVHReference const &reference : references)
+        {
+          int firstBin = spatialBinOf(box, width, axis, reference.box.min[axis]);
+          int lastBin = spatialBinOf(box, width, axis, reference.box.max[axis]);
+          bins[firstBin].entries++;
+          bins[lastBin].exits++;
+          binTriangle(bins, &corners[3 * reference.primitive], axis, box, width, firstBin, lastBin, reference.box);
+        }
+
+        int bin;
+        double cost = spatialCost;
+        if (sweepBins(bins, cost, bin))
+        {
+          // References on both sides, within the budget
+          int leftCount = 0;
+          int rightCount = 0;
+          for (int b = 0; b < BVH::SAH_BINS; ++b)
+          {
+            if (b <= bin)
+            {
+              leftCount += bins[b].entries;
+            }
+            else
+            {
+              rightCount += bins[b].exits;
+            }
+          }
+          if (referenceCount + leftCount + rightCount - count <= referenceLimit)
+          {
+            spatialCost = cost;
+            spatialAxis = axis;
+            spatialBin = bin;
+          }
+        }
+      }
+    }
+
+    double bestCost = std::min(objectCost, spatialCost);
+    if (objectAxis < 0 && spatialAxis < 0)
+    {
+      return false;
+    }
+    double area = box.area();
+    bestCost = area > 0 ? 1 + bestCost / area : count;
+    if (count <= BVH::MAX_LEAF && bestCost >= count)
+    {
+      return false;
+    }
+
+    if (spatialAxis >= 0 && spatialCost < objectCost)
+    {
+      int axis = spatialAxis;
+      double width = (box.max[axis] - box.min[axis]) / BVH::SAH_BINS;
+      double position = box.min[axis] + (spatialBin + 1) * width;
+      for (BVHReference const &reference : references)
+      {
+        if (reference.box.max[axis] <= position)
+        {
+          left.push_back(reference);
+        }
+        else if (reference.box.min[axis] >= position)
+        {
+          right.push_back(reference);
+        }
+        else
+        {
+          // Crosses the plane: one part on each side
+          Vector3 const *triangle = &corners[3 * reference.primitive];
+          Bounds leftPart = clipTriangle(triangle, axis, reference.box.min[axis], position, reference.box);
+          Bounds rightPart = clipTriangle(triangle, axis, position, reference.box.max[axis], reference.box);
+          if (!leftPart.empty())
+          {
+            left.push_back({reference.primitive, leftPart});
+          }
+          if (!rightPart.empty())
+          {
+            right.push_back({reference.primitive, rightPart});
+          }
+        }
+      }
+      if (!left.empty() && !right.empty())
+      {
+        referenceCount += left.size() + right.size() - count;
+        return true;
+      }
+      left.clear();
+      right.clear();
+      if (objectAxis < 0)
+      {
+        return false;
+      }
+    }
+
+    for (BVHReference const &reference : references)
+    {
+      int b = std::min(BVH::SAH_BINS - 1, (int)((reference.box.center(objectAxis) - center.min[objectAxis]) * objectScale[objectAxis]));
+      if (b <= objectBin)
+      {
+        left.push_back(reference);
+      }
+      else
+      {
+        right.push_back(reference);
+      }
+    }
+    return true;
+  }
+
+  static int spatialBinOf(Bounds const &box, double width, int axis, double position)
+  {
+    return std::min(BVH::SAH_BINS - 1, std::max(0, (int)((position - box.min[axis]) / width)));
+  }
+
+  static void splitMedian(std::vector<BVHReference> &references, Bounds const &center,
+                          std::vector<BVHReference> &left, std::vector<BVHReference> &right)
+  {
+    int axis = 0;
+    for (int a = 1; a < 3; ++a)
+    {
+      if (center.max[a] - center.min[a] > center.max[axis] - center.min[axis])
+      {
+        axis = a;
+      }
+    }
+    int half = references.size() / 2;
+    std::nth_element(references.begin(), references.begin() + half, references.end(),
+                     [axis](BVHReference const &a, BVHReference const &b)
+                     { return a.box.center(axis) < b.box.center(axis); });
+    left.assign(references.begin(), references.begin() + half);
+    right.assign(references.begin() + half, references.end());
+  }
+};
+
+/**
+ * Float box containing the double one, enlarged by a small margin
+ */
+static void storeChild(BVH::WideNode &node, int c, Bounds const &box)
+{
+  double extent = std::max(box.max[0] - box.min[0], std::max(box.max[1] - box.min[1], box.max[2] - box.min[2]));
+  double magnitude = 0;
+  for (int axis = 0; axis < 3; ++axis)
+  {
+    magnitude = std::max(magnitude, std::max(std::abs(box.min[axis]), std::abs(box.max[axis])));
+  }
+  double margin = extent * 1e-5 + magnitude * 1e-6 + 1e-9;
+
+  float *mins[3] = {node.minX, node.minY, node.minZ};
+  float *maxs[3] = {node.maxX, node.maxY, node.maxZ};
+  for (int axis = 0; axis < 3; ++axis)
+  {
+    float low = (float)(box.min[axis] - margin);
+    float high = (float)(box.max[axis] + margin);
+    mins[axis][c] = low > box.min[axis] - margin ? std::nextafter(low, -INFINITY) : low;
+    maxs[axis][c] = high < box.max[axis] + margin ? std::nextafter(high, INFINITY) : high;
+  }
+}
+
+/**
+ * Wide node of the binary node index (and, recursively, of its descendants)
+ */
+static int collapse(std::vector<BVH::WideNode> &nodes, std::vector<BVHBuildNode> const &binary, int index)
+{
+  int wide = nodes.size();
+  nodes.push_back(BVH::WideNode());
+
+  // Open the largest inner children until there are WIDTH of them
+  std::vector<int> children;
+  if (binary[index].count > 0 || binary[index].left < 0)
+  {
+    children.push_back(index);
+  }
+  else
+  {
+    children.push_back(binary[index].left);
+    children.push_back(binary[index].right);
+  }
+  while (children.size() < BVH::WIDTH)
+  {
+    int largest = -1;
+    for (int c = 0; c < children.size(); ++c)
+    {
+      BVHBuildNode const &child = binary[children[c]];
+      if (child.left >= 0 && (largest < 0 || child.box.area() > binary[children[largest]].box.area()))
+      {
+        largest = c;
+      }
+    }
+    if (largest < 0)
+    {
+      break;
+    }
+    BVHBuildNode const &opened = binary[children[largest]];
+    children[largest] = opened.left;
+    children.push_back(opened.right);
+  }
+
+  BVH::WideNode node;
+  for (int c = 0; c < BVH::WIDTH; ++c)
+  {
+    if (c >= children.size())
+    {
+      node.minX[c] = node.minY[c] = node.minZ[c] = INFINITY;
+      node.maxX[c] = node.maxY[c] = node.maxZ[c] = -INFINITY;
+      node.child[c] = 0;
+      node.count[c] = -1;
+      continue;
+    }
+    BVHBuildNode const &child = binary[children[c]];
+    storeChild(node, c, child.box);
+    if (child.left < 0)
+    {
+      node.child[c] = child.first;
+      node.count[c] = child.count;
+    }
+    else
+    {
+      node.child[c] = collapse(nodes, binary, children[c]);
+      node.count[c] = 0;
+    }
+  }
+  nodes[wide] = node;
+  return wide;
+}
+
+void BVH::build(std::vector<Bounds> const &primitives, BVHSettings const &settings, std::vector<Vector3> const *corners)
+{
+  nodes.clear();
+  compactNodes.clear();
+  order.resize(primitives.size());
+  for (int i = 0; i < primitives.size(); ++i)
+  {
+    order[i] = i;
+  }
+  if (primitives.empty())
+  {
+    return;
+  }
+
+  if (settings.method == BVH_BUILD_SBVH && corners != NULL && corners->size() == 3 * primitives.size())
+  {
+    SpatialBVHBuilder builder(primitives, *corners, order, settings.splitBudget);
+    builder.build();
+    nodes.reserve(builder.nodes.size());
+    collapse(nodes, builder.nodes, 0);
+  }
+  else
+  {
+    BVHBuilder builder(primitives, order, settings.method == BVH_BUILD_LBVH ? BVH_BUILD_LBVH : BVH_BUILD_SAH);
+    builder.build();
+    nodes.reserve(builder.nodeCount);
+    collapse(nodes, builder.nodes, 0);
+  }
+
+  if (settings.compressed)
+  {
+    compress();
+  }
+}
+
+/**
+ * 2^exponent, for exponents of normal floats
+ */
+static float powerOfTwo(int exponent)
+{
+  uint32_t bits = (uint32_t)(exponent + 127) << 23;
+  float result;
+  std::memcpy(&result, &bits, sizeof(result));
+  return result;
+}
+
+void BVH::compress()
+{
+  compactNodes.resize(nodes.size());
+  for (size_t i = 0; i < nodes.size(); ++i)
+  {
+    WideNode const &node = nodes[i];
+    CompactNode &compact = compactNodes[i];
+    float const *mins[3] = {node.minX, node.minY, node.minZ};
+    float const *maxs[3] = {node.maxX, node.maxY, node.maxZ};
+    uint8_t *quantizedMins[3] = {compact.minX, compact.minY, compact.minZ};
+    uint8_t *quantizedMaxs[3] = {compact.maxX, compact.maxY, compact.maxZ};
+
+    for (int axis = 0; axis < 3; ++axis)
+    {
+      // Box of the node, and the smallest power of two step covering it in 254 steps
+      float low = INFINITY;
+      float high = -INFINITY;
+      for (int c = 0; c < WIDTH; ++c)
+      {
+        if (node.count[c] >= 0)
+        {
+          low = std::min(low, mins[axis][c]);
+          high = std::max(high, maxs[axis][c]);
+        }
+      }
+      int exponent = -100;
+      if (high > low)
+      {
+        std::frexp(((double)high - low) / 254, &exponent);
+      }
+      exponent = std::max(-126, std::min(127, exponent));
+      float scale = powerOfTwo(exponent);
+      compact.origin[axis] = low;
+      compact.exponent[axis] = exponent;
+
+      // Rounded outwards, checked with the float operations of the traversal
+      for (int c = 0; c < WIDTH; ++c)
+      {
+        if (node.count[c] < 0)
+        {
+          quantizedMins[axis][c] = 255;
+          quantizedMaxs[axis][c] = 0;
+          continue;
+        }
+        int qMin = std::max(0, std::min(255, (int)std::floor((mins[axis][c] - (double)low) / scale)));
+        while (qMin > 0 && low + (float)qMin * scale > mins[axis][c])
+        {
+          qMin--;
+        }
+        int qMax = std::max(0, std::min(255, (int)std::ceil((maxs[axis][c] - (double)low) / scale)));
+        while (qMax < 255 && low + (float)qMax * scale < maxs[axis][c])
+        {
+          qMax++;
+        }
+        quantizedMins[axis][c] = qMin;
+        quantizedMaxs[axis][c] = qMax;
+      }
+    }
+
+    for (int c = 0; c < WIDTH; ++c)
+    {
+      compact.child[c] = node.child[c];
+      compact.count[c] = node.count[c];
+    }
+  }
+
+  std::vector<WideNode>().swap(nodes);
+}
+
+BVH::RayData BVH::prepareRay(Ray &r)
+{
+  Vector3 o = r.GetPosition();
+  Vector3 d = r.GetDirection();
+  double p[3] = {o.x, o.y, o.z};
+  double v[3] = {d.x, d.y, d.z};
+
+  RayData ray;
+  for (int axis = 0; axis < 3; ++axis)
+  {
+    ray.origin[axis] = p[axis];
+    // Finite inverse (no 0 * infinity in the slab tests), large enough to keep parallel rays correct
+    double inverse = 1.0 / v[axis];
+    ray.inverse[axis] = std::isfinite(inverse) ? (float)std::max(-1e30, std::min(1e30, inverse)) : std::copysign(1e30f, (float)inverse);
+  }
+  return ray;
+}
+
+#if defined(__SSE2__)
+/**
+ * Slab test of the ray against 4 boxes. Returns the mask of the boxes hit, with their entry distances in tNear.
+ */
+static int slabTest(__m128 minX, __m128 minY, __m128 minZ, __m128 maxX, __m128 maxY, __m128 maxZ,
+                    BVH::RayData const &ray, float tMax, float tNear[BVH::WIDTH])
+{
+  __m128 ox = _mm_set1_ps(ray.origin[0]), oy = _mm_set1_ps(ray.origin[1]), oz = _mm_set1_ps(ray.origin[2]);
+  __m128 ix = _mm_set1_ps(ray.inverse[0]), iy = _mm_set1_ps(ray.inverse[1]), iz = _mm_set1_ps(ray.inverse[2]);
+
+  __m128 t1 = _mm_mul_ps(_mm_sub_ps(minX, ox), ix);
+  __m128 t2 = _mm_mul_ps(_mm_sub_ps(maxX, ox), ix);
+  __m128 tmin = _mm_min_ps(t1, t2);
+  __m128 tmax = _mm_max_ps(t1, t2);
+
+  t1 = _mm_mul_ps(_mm_sub_ps(minY, oy), iy);
+  t2 = _mm_mul_ps(_mm_sub_ps(maxY, oy), iy);
+  tmin = _mm_max_ps(tmin, _mm_min_ps(t1, t2));
+  tmax = _mm_min_ps(tmax, _mm_max_ps(t1, t2));
+
+  t1 = _mm_mul_ps(_mm_sub_ps(minZ, oz), iz);
+  t2 = _mm_mul_ps(_mm_sub_ps(maxZ, oz), iz);
+  tmin = _mm_max_ps(tmin, _mm_min_ps(t1, t2));
+  tmax = _mm_min_ps(tmax, _mm_max_ps(t1, t2));
+
+  // Slab test: the box is crossed (tmax >= tmin), ahead of the origin (tmax > 0) and entered before the end of the ray
+  __m128 hit = _mm_and_ps(_mm_cmpge_ps(tmax, tmin), _mm_cmpgt_ps(tmax, _mm_setzero_ps()));
+  hit = _mm_and_ps(hit, _mm_cmple_ps(tmin, _mm_set1_ps(tMax)));
+  _mm_storeu_ps(tNear, _mm_max_ps(tmin, _mm_setzero_ps()));
+
+  return _mm_movemask_ps(hit);
+}
+
+/**
+ * origin + q * scale for 4 quantized coordinates
+ */
+static __m128 dequantize(uint8_t const *quantized, float origin, float scale)
+{
+  int32_t packed;
+  std::memcpy(&packed, quantized, sizeof(packed));
+  __m128i zero = _mm_setzero_si128();
+  __m128i words = _mm_unpacklo_epi8(_mm_cvtsi32_si128(packed), zero);
+  __m128 values = _mm_cvtepi32_ps(_mm_unpacklo_epi16(words, zero));
+  return _mm_add_ps(_mm_set1_ps(origin), _mm_mul_ps(values, _mm_set1_ps(scale)));
+}
+#else
+static int slabTest(float const *const mins[3], float const *const maxs[3], BVH::RayData const &ray, float tMax,
+                    float tNear[BVH::WIDTH])
+{
+  int mask = 0;
+  for (int c = 0; c < BVH::WIDTH; ++c)
+  {
+    float tmin = -INFINITY;
+    float tmax = INFINITY;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+      float t1 = (mins[axis][c] - ray.origin[axis]) * ray.inverse[axis];
+      float t2 = (maxs[axis][c] - ray.origin[axis]) * ray.inverse[axis];
+      tmin = std::max(tmin, std::min(t1, t2));
+      tmax = std::min(tmax, std::max(t1, t2));
+    }
+    tNear[c] = std::max(tmin, 0.0f);
+    if (tmax >= tmin && tmax > 0 && tmin <= tMax)
+    {
+      mask |= 1 << c;
+    }
+  }
+  return mask;
+}
+#endif
+
+/**
+ * Mask without the empty slots of a node
+ */
+template <typename Count>
+static int validChildren(int mask, Count const *count)
+{
+  for (int c = 0; c < BVH::WIDTH; ++c)
+  {
+    if (count[c] < 0)
+    {
+      mask &= ~(1 << c);
+    }
+  }
+  return mask;
+}
+
+int BVH::intersectChildren(WideNode const &node, RayData const &ray, float tMax, float tNear[WIDTH])
+{
+#if defined(__SSE2__)
+  int mask = slabTest(_mm_loadu_ps(node.minX), _mm_loadu_ps(node.minY), _mm_loadu_ps(node.minZ),
+                      _mm_loadu_ps(node.maxX), _mm_loadu_ps(node.maxY), _mm_loadu_ps(node.maxZ), ray, tMax, tNear);
+#else
+  float const *mins[3] = {node.minX, node.minY, node.minZ};
+  float const *maxs[3] = {node.maxX, node.maxY, node.maxZ};
+  int mask = slabTest(mins, maxs, ray, tMax, tNear);
+#endif
+  return validChildren(mask, node.count);
+}
+
+int BVH::intersectChildren(CompactNode const &node, RayData const &ray, float tMax, float tNear[WIDTH])
+{
+  float scale[3];
+  for (int axis = 0; axis < 3; ++axis)
+  {
+    scale[axis] = powerOfTwo(node.exponent[axis]);
+  }
+#if defined(__SSE2__)
+  int mask = slabTest(dequantize(node.minX, node.origin[0], scale[0]), dequantize(node.minY, node.origin[1], scale[1]),
+                      dequantize(node.minZ, node.origin[2], scale[2]), dequantize(node.maxX, node.origin[0], scale[0]),
+                      dequantize(node.maxY, node.origin[1], scale[1]), dequantize(node.maxZ, node.origin[2], scale[2]),
+                      ray, tMax, tNear);
+#else
+  uint8_t const *quantized[6] = {node.minX, node.minY, node.minZ, node.maxX, node.maxY, node.maxZ};
+  float bounds[6][WIDTH];
+  for (int i = 0; i < 6; ++i)
+  {
+    for (int c = 0; c < WIDTH; ++c)
+    {
+      bounds[i][c] = node.origin[i % 3] + (float)quantized[i][c] * scale[i % 3];
+    }
+  }
+  float const *mins[3] = {bounds[0], bounds[1], bounds[2]};
+  float const *maxs[3] = {bounds[3], bounds[4], bounds[5]};
+  int mask = slabTest(mins, maxs, ray, tMax, tNear);
+#endif
+  return validChildren(mask, node.count);
+}
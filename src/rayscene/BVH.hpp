@@ -0,0 +1,208 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "../raymath/Vector3.hpp"
+#include "../raymath/Ray.hpp"
+#include "Bounds.hpp"
+
+/**
+ * How the binary tree of a BVH is built
+ */
+enum BVHBuild
+{
+  // Binned surface area heuristic: the fastest tree to traverse
+  BVH_BUILD_SAH,
+  // Primitives sorted along a Morton curve (LBVH): much faster to build, slower to traverse (previews)
+  BVH_BUILD_LBVH,
+  // SAH with spatial splits (SBVH): triangles crossing a split are referenced on both sides,
+  // so long thin triangles no longer make the boxes overlap. Slower to build (final renders)
+  BVH_BUILD_SBVH
+};
+
+struct BVHSettings
+{
+  BVHBuild method = BVH_BUILD_SAH;
+  // SBVH: at most this many extra references to the triangles, as a fraction of their number
+  double splitBudget = 0.5;
+  // Children boxes quantized to 8 bits in their parent box (nodes of 64 bytes instead of 128)
+  bool compressed = false;
+};
+
+/**
+ * Bounding volume hierarchy over primitives known by their index and bounds.
+ * A binary tree is built (with the surface area heuristic, or along a Morton curve), then collapsed into a tree
+ * of 4-wide nodes: the 4 children boxes of a node are stored as arrays (SoA) and tested
+ * against the ray at once with SSE. Children are visited from the nearest to the farthest.
+ */
+class BVH
+{
+public:
+  static constexpr int WIDTH = 4;
+  static constexpr int MAX_LEAF = 4;
+  // Below this depth, nodes are split at the median instead of with the SAH (or the Morton codes)...
+  static constexpr int SAH_DEPTH = 48;
+  // ...which bounds the depth of the tree (for up to 2^31 primitives)
+  static constexpr int MAX_DEPTH = SAH_DEPTH + 32;
+  static constexpr int SAH_BINS = 32;
+
+  struct alignas(64) WideNode
+  {
+    // Children boxes, slightly enlarged so float rounding never misses a primitive
+    float minX[WIDTH], minY[WIDTH], minZ[WIDTH];
+    float maxX[WIDTH], maxY[WIDTH], maxZ[WIDTH];
+    // Inner child: index of the node. Leaf: index of its first primitive in order
+    int child[WIDTH];
+    // Number of primitives of a leaf, 0 for an inner child, -1 for an empty slot
+    int count[WIDTH];
+  };
+
+  /**
+   * Ray in the form used by the box tests
+   */
+  struct RayData
+  {
+    float origin[3];
+    float inverse[3];
+  };
+
+  /**
+   * Same node with the children boxes quantized, on one cache line: a box is
+   * origin + q * 2^exponent on each axis, with q on 8 bits rounded outwards.
+   */
+  struct alignas(64) CompactNode
+  {
+    int child[WIDTH];
+    float origin[3];
+    uint8_t minX[WIDTH], minY[WIDTH], minZ[WIDTH];
+    uint8_t maxX[WIDTH], maxY[WIDTH], maxZ[WIDTH];
+    int8_t exponent[3];
+    int8_t count[WIDTH];
+  };
+  static_assert(sizeof(CompactNode) == 64, "compact BVH nodes fill one cache line");
+
+  // Only one of them is used, depending on BVHSettings::compressed
+  std::vector<WideNode> nodes;
+  std::vector<CompactNode> compactNodes;
+  // Primitive indices, the leaves refer to ranges of it (with the SBVH, a primitive may be in several leaves)
+  std::vector<int> order;
+
+  /**
+   * Builds the tree on the shared thread pool: the large nodes are binned in parallel,
+   * and the subtrees are built as separate tasks (except for the SBVH, built on the calling thread).
+   * The spatial splits need the corners of the primitives (3 per primitive, triangles):
+   * without them, the SBVH falls back to the SAH.
+   */
+  void build(std::vector<Bounds> const &primitives, BVHSettings const &settings = BVHSettings(),
+             std::vector<Vector3> const *corners = NULL);
+  bool empty() const { return nodes.empty() && compactNodes.empty(); }
+
+  /**
+   * Visits the leaves whose box is entered before tMax (which may shrink during the traversal).
+   * leaf(first, count) is called for the primitives order[first .. first + count[ and returns
+   * true to stop the traversal.
+   */
+  template <typename Leaf>
+  void traverse(Ray &r, double const &tMax, Leaf leaf) const;
+
+private:
+  template <typename Node, typename Leaf>
+  static void traverseNodes(std::vector<Node> const &tree, Ray &r, double const &tMax, Leaf leaf);
+
+  void compress();
+
+  static RayData prepareRay(Ray &r);
+
+  /**
+   * Tests the ray against the children of a node. Returns a mask of the children hit,
+   * with their entry distances in tNear.
+   */
+  static int intersectChildren(WideNode const &node, RayData const &ray, float tMax, float tNear[WIDTH]);
+  static int intersectChildren(CompactNode const &node, RayData const &ray, float tMax, float tNear[WIDTH]);
+};
+
+/**
+ * Slack on the end of the ray for box tests: primitives compute their distance in float,
+ * so a box entered right after tMax may still contain a hit at tMax.
+ */
+inline float bvhRayEnd(double tMax)
+{
+  return (float)(tMax * (1 + 1e-5)) + 1e-6f;
+}
+
+template <typename Leaf>
+void BVH::traverse(Ray &r, double const &tMax, Leaf leaf) const
+{
+  if (!compactNodes.empty())
+  {
+    traverseNodes(compactNodes, r, tMax, leaf);
+  }
+  else if (!nodes.empty())
+  {
+    traverseNodes(nodes, r, tMax, leaf);
+  }
+}
+
+template <typename Node, typename Leaf>
+void BVH::traverseNodes(std::vector<Node> const &tree, Ray &r, double const &tMax, Leaf leaf)
+{
+  RayData ray = prepareRay(r);
+
+  struct Entry
+  {
+    int node;
+    float tNear;
+  };
+  // Each level pushes at most WIDTH - 1 entries, and the depth is bounded by the build
+  Entry stack[MAX_DEPTH * (WIDTH - 1) + 1];
+  int size = 0;
+  stack[size++] = {0, 0};
+
+  while (size > 0)
+  {
+    Entry entry = stack[--size];
+    if (entry.tNear > bvhRayEnd(tMax))
+    {
+      continue;
+    }
+
+    Node const &node = tree[entry.node];
+    float tNear[WIDTH];
+    int mask = intersectChildren(node, ray, bvhRayEnd(tMax), tNear);
+
+    // Children hit, sorted from the nearest to the farthest
+    int hits[WIDTH];
+    int hitCount = 0;
+    for (int c = 0; c < WIDTH; ++c)
+    {
+      if (mask & (1 << c))
+      {
+        int k = hitCount++;
+        while (k > 0 && tNear[hits[k - 1]] > tNear[c])
+        {
+          hits[k] = hits[k - 1];
+          k--;
+        }
+        hits[k] = c;
+      }
+    }
+
+    // Leaves right away (nearest first), inner nodes pushed so the nearest is popped first
+    for (int h = 0; h < hitCount; ++h)
+    {
+      int c = hits[h];
+      if (node.count[c] > 0 && tNear[c] <= bvhRayEnd(tMax) && leaf(node.child[c], node.count[c]))
+      {
+        return;
+      }
+    }
+    for (int h = hitCount - 1; h >= 0; --h)
+    {
+      int c = hits[h];
+      if (node.count[c] == 0)
+      {
+        stack[size++] = {node.child[c], tNear[c]};
+      }
+    }
+  }
+}
@@ -0,0 +1,43 @@
+#include <algorithm>
+#include <cmath>
+#include "Bounds.hpp"
+
+Bounds::Bounds()
+{
+  for (int axis = 0; axis < 3; ++axis)
+  {
+    min[axis] = INFINITY;
+    max[axis] = -INFINITY;
+  }
+}
+
+void Bounds::grow(Vector3 const &point)
+{
+  double p[3] = {point.x, point.y, point.z};
+  for (int axis = 0; axis < 3; ++axis)
+  {
+    min[axis] = std::min(min[axis], p[axis]);
+    max[axis] = std::max(max[axis], p[axis]);
+  }
+}
+
+void Bounds::grow(Bounds const &other)
+{
+  for (int axis = 0; axis < 3; ++axis)
+  {
+    min[axis] = std::min(min[axis], other.min[axis]);
+    max[axis] = std::max(max[axis], other.max[axis]);
+  }
+}
+
+double Bounds::area() const
+{
+  double dx = max[0] - min[0];
+  double dy = max[1] - min[1];
+  double dz = max[2] - min[2];
+  if (dx < 0 || dy < 0 || dz < 0)
+  {
+    return 0;
+  }
+  return 2 * (dx * dy + dy * dz + dz * dx);
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "../raymath/Vector3.hpp"
+
+/**
+ * Axis aligned box, with the axes indexable (0 = x, 1 = y, 2 = z) and empty until grown,
+ * which the BVH builders rely on (raymath's AABB has neither).
+ */
+struct Bounds
+{
+  double min[3];
+  double max[3];
+
+  Bounds();
+  void grow(Vector3 const &point);
+  void grow(Bounds const &other);
+  double area() const;
+  bool empty() const { return min[0] > max[0] || min[1] > max[1] || min[2] > max[2]; }
+  double center(int axis) const { return (min[axis] + max[axis]) / 2; }
+};
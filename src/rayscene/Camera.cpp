@@ -1,28 +1,61 @@
 #include <iostream>
 #include <cmath>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include <iterator>
+#include <cstdint>
 #include "Camera.hpp"
 #include "../raymath/Ray.hpp"
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 // On inclut les librairies de thread seulement si la directive est active
 #ifdef ENABLE_MULTITHREADING
 #include <thread>
-#include <vector>
+#include "ThreadPool.hpp"
 #endif
 
+/**
+ * Terms of the primary ray directions of a frame, for a given sub-pixel offset: the direction
+ * through pixel (x, y) is the sum of a term of its column and a term of its row.
+ */
+struct PrimaryRays
+{
+  // Column terms as arrays, loaded two at a time
+  std::vector<double> columnX;
+  std::vector<double> columnY;
+  std::vector<double> columnZ;
+  std::vector<Vector3> rows;
+
+  /**
+   * Normalized directions of the pixels [x0, x1[ of row y, into out
+   */
+  void directions(int y, int x0, int x1, Vector3 *out) const;
+};
+
 struct RenderSegment
 {
 public:
-  int rowMin;
-  int rowMax;
   Image *image;
+  // Eye, and orthonormal basis of the camera: the image plane is at distance 1 along forward
+  Vector3 origin;
+  Vector3 right;
+  Vector3 up;
+  Vector3 forward;
+  // Size of the image plane, and of a pixel on it
+  double width;
   double height;
   double intervalX;
   double intervalY;
+  // Terms of the rays through the top left corners of the pixels
+  PrimaryRays rays;
   int reflections;
   Scene *scene;
 };
 
-Camera::Camera() : position(Vector3())
+Camera::Camera() : position(Vector3(0, 0, -1))
 {
 }
 
@@ -45,101 +78,725 @@ void Camera::setPosition(Vector3 &pos)
 }
 
 /**
- * Render a segment (set of rows) of the image
+ * Eye of the primary rays
+ */
+Vector3 primaryOrigin(RenderSegment *segment)
+{
+  return segment->origin;
+}
+
+/**
+ * Part of the primary direction given by the column x of the image, in pixels
+ */
+static Vector3 columnTerm(RenderSegment *segment, double x)
+{
+  double xCoord = -segment->width / 2.0 + (x * segment->intervalX);
+  return segment->right * xCoord;
+}
+
+/**
+ * Part of the primary direction given by the row y of the image, in pixels (forward included)
+ */
+static Vector3 rowTerm(RenderSegment *segment, double y)
+{
+  double yCoord = (segment->height / 2.0) - (y * segment->intervalY);
+  return segment->forward + segment->up * yCoord;
+}
+
+/**
+ * Direction (not normalized) of the primary ray going through the point (x, y) of the image, in pixels
+ */
+Vector3 primaryDirection(RenderSegment *segment, double x, double y)
+{
+  return columnTerm(segment, x) + rowTerm(segment, y);
+}
+
+/**
+ * Terms of the primary rays of a frame of the given size, shifted by (dx, dy) pixels
+ */
+static PrimaryRays primaryRays(RenderSegment *segment, int width, int height, double dx, double dy)
+{
+  PrimaryRays rays;
+  for (int x = 0; x < width; ++x)
+  {
+    Vector3 term = columnTerm(segment, x + dx);
+    rays.columnX.push_back(term.x);
+    rays.columnY.push_back(term.y);
+    rays.columnZ.push_back(term.z);
+  }
+  for (int y = 0; y < height; ++y)
+  {
+    rays.rows.push_back(rowTerm(segment, y + dy));
+  }
+  return rays;
+}
+
+void PrimaryRays::directions(int y, int x0, int x1, Vector3 *out) const
+{
+  Vector3 const &row = rows[y];
+  int x = x0;
+#if defined(__SSE2__)
+  // Same operations as Vector3::normalize, two directions at a time
+  __m128d rowX = _mm_set1_pd(row.x), rowY = _mm_set1_pd(row.y), rowZ = _mm_set1_pd(row.z);
+  __m128d zero = _mm_setzero_pd();
+  for (; x + 2 <= x1; x += 2)
+  {
+    __m128d dx = _mm_add_pd(_mm_loadu_pd(&columnX[x]), rowX);
+    __m128d dy = _mm_add_pd(_mm_loadu_pd(&columnY[x]), rowY);
+    __m128d dz = _mm_add_pd(_mm_loadu_pd(&columnZ[x]), rowZ);
+    __m128d length = _mm_sqrt_pd(_mm_add_pd(_mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy)), _mm_mul_pd(dz, dz)));
+    __m128d valid = _mm_cmpneq_pd(length, zero);
+    dx = _mm_and_pd(_mm_div_pd(dx, length), valid);
+    dy = _mm_and_pd(_mm_div_pd(dy, length), valid);
+    dz = _mm_and_pd(_mm_div_pd(dz, length), valid);
+
+    Vector3 *pair = out + (x - x0);
+    _mm_storel_pd(&pair[0].x, dx);
+    _mm_storel_pd(&pair[0].y, dy);
+    _mm_storel_pd(&pair[0].z, dz);
+    _mm_storeh_pd(&pair[1].x, dx);
+    _mm_storeh_pd(&pair[1].y, dy);
+    _mm_storeh_pd(&pair[1].z, dz);
+  }
+#endif
+  for (; x < x1; ++x)
+  {
+    out[x - x0] = (Vector3(columnX[x], columnY[x], columnZ[x]) + row).normalize();
+  }
+}
+
+/**
+ * Position (x, y) of the image, in pixels, where the point is seen.
+ * Returns false for a point that is not in front of the eye.
  */
-void renderSegment(RenderSegment *segment)
+bool projectPoint(RenderSegment *segment, Vector3 const &point, double &x, double &y)
 {
-  // Note: On parcourt de rowMin à rowMax (exclusif)
-  for (int y = segment->rowMin; y < segment->rowMax; ++y)
+  Vector3 v = point - primaryOrigin(segment);
+  double depth = v.dot(segment->forward);
+  if (!(depth > 0))
   {
-    double yCoord = (segment->height / 2.0) - (y * segment->intervalY);
+    return false;
+  }
+  x = (v.dot(segment->right) / depth + segment->width / 2.0) / segment->intervalX;
+  y = (segment->height / 2.0 - v.dot(segment->up) / depth) / segment->intervalY;
+  return true;
+}
+
+/**
+ * Traces the primary ray going through the point (x, y) of the image, in pixels.
+ * Its first intersection is looked for in objects when given (see Scene::cullObjects).
+ */
+Color tracePrimary(RenderSegment *segment, double x, double y, SceneBuckets *objects = NULL)
+{
+  Ray ray(primaryOrigin(segment), primaryDirection(segment, x, y));
 
-    for (int x = 0; x < segment->image->width; ++x)
+  return segment->scene->raycast(ray, ray, 0, segment->reflections, objects);
+}
+
+/**
+ * Traces a primary ray of the given normalized direction (see PrimaryRays::directions)
+ */
+Color tracePrimary(RenderSegment *segment, Vector3 const &direction, SceneBuckets *objects = NULL)
+{
+  Ray ray(primaryOrigin(segment), direction, true);
+
+  return segment->scene->raycast(ray, ray, 0, segment->reflections, objects);
+}
+
+/**
+ * Segment covering a whole frame of the given size, seen by the camera
+ */
+RenderSegment frameSegment(Camera &camera, unsigned int width, unsigned int height, Image *image, Scene *scene,
+                           int reflections)
+{
+  RenderSegment seg;
+  seg.origin = camera.getPosition();
+  seg.forward = (camera.lookAt - seg.origin).normalize();
+  seg.right = camera.up.cross(seg.forward).normalize();
+  seg.up = seg.forward.cross(seg.right);
+
+  // Without a field of view, the image plane of the original camera (exactly 1 wide)
+  seg.width = camera.fov > 0 ? 2.0 * std::tan(camera.fov * M_PI / 360.0) : 1.0;
+  double aspect = camera.aspect > 0 ? camera.aspect : (double)width / (double)height;
+  seg.height = seg.width / aspect;
+  seg.image = image;
+  seg.scene = scene;
+  seg.intervalX = seg.width / (double)width;
+  seg.intervalY = seg.height / (double)height;
+  seg.rays = primaryRays(&seg, width, height, 0, 0);
+  seg.reflections = reflections;
+  return seg;
+}
+
+/**
+ * Calls renderRow(y) for each row (or each tile), spread over all the cores when multithreading is enabled.
+ * renderRow returns false to skip the remaining rows.
+ */
+template <typename F>
+void forEachRow(int rows, F renderRow)
+{
+#ifdef ENABLE_MULTITHREADING
+  // Workers of the shared pool, plus the calling thread: no thread is created per call
+  ThreadPool &pool = ThreadPool::shared();
+
+  std::atomic<int> nextRow(0);
+  std::atomic<bool> stopped(false);
+  auto worker = [&]()
+  {
+    int y;
+    while (!stopped && (y = nextRow++) < rows)
+    {
+      if (!renderRow(y))
+      {
+        stopped = true;
+      }
+    }
+  };
+
+  std::vector<std::future<void>> workers;
+  for (unsigned int i = 0; i < pool.size(); ++i)
+  {
+    workers.push_back(pool.submit(worker));
+  }
+  worker();
+  for (auto &w : workers)
+  {
+    pool.wait(w);
+  }
+#else
+  for (int y = 0; y < rows; ++y)
+  {
+    if (!renderRow(y))
     {
-      double xCoord = -0.5 + (x * segment->intervalX);
+      break;
+    }
+  }
+#endif
+}
 
-      Vector3 coord(xCoord, yCoord, 0);
-      Vector3 origin(0, 0, -1);
-      Ray ray(origin, coord - origin);
+// Side of the tiles, in pixels (a power of two: pixels are visited in Z-order inside a tile)
+static const int TILE_SIZE = 16;
 
-      Color pixel = segment->scene->raycast(ray, ray, 0, segment->reflections);
-      segment->image->setPixel(x, y, pixel);
+struct Tile
+{
+  int x0;
+  int y0;
+  int x1;
+  int y1;
+  // Position in the grid of tiles
+  int column;
+  int row;
+};
+
+/**
+ * Interleaves the bits of x and y (16 bits each): position along the Z-order (Morton) curve
+ */
+static uint32_t mortonCode2(uint32_t x, uint32_t y)
+{
+  auto spread = [](uint32_t v)
+  {
+    v &= 0xffff;
+    v = (v | (v << 8)) & 0x00ff00ff;
+    v = (v | (v << 4)) & 0x0f0f0f0f;
+    v = (v | (v << 2)) & 0x33333333;
+    v = (v | (v << 1)) & 0x55555555;
+    return v;
+  };
+  return spread(x) | (spread(y) << 1);
+}
+
+struct TilePixel
+{
+  uint8_t dx;
+  uint8_t dy;
+};
+
+/**
+ * Offsets of the pixels of a tile, in Z-order (computed once)
+ */
+static std::vector<TilePixel> const &tilePixels()
+{
+  static std::vector<TilePixel> const pixels = []()
+  {
+    std::vector<TilePixel> order(TILE_SIZE * TILE_SIZE);
+    for (int dy = 0; dy < TILE_SIZE; ++dy)
+    {
+      for (int dx = 0; dx < TILE_SIZE; ++dx)
+      {
+        order[mortonCode2(dx, dy)] = {(uint8_t)dx, (uint8_t)dy};
+      }
     }
+    return order;
+  }();
+  return pixels;
+}
+
+/**
+ * Tiles covering [x0, x1[ x [y0, y1[, in Z-order: consecutive tiles (and the pixels inside a tile)
+ * stay close on screen, so do the parts of the scene their rays go through.
+ */
+static std::vector<Tile> mortonTiles(int x0, int y0, int x1, int y1)
+{
+  std::vector<std::pair<uint32_t, Tile>> coded;
+  for (int ty = 0; y0 + ty * TILE_SIZE < y1; ++ty)
+  {
+    for (int tx = 0; x0 + tx * TILE_SIZE < x1; ++tx)
+    {
+      Tile tile = {x0 + tx * TILE_SIZE, y0 + ty * TILE_SIZE,
+                   std::min(x0 + (tx + 1) * TILE_SIZE, x1), std::min(y0 + (ty + 1) * TILE_SIZE, y1), tx, ty};
+      coded.push_back({mortonCode2(tx, ty), tile});
+    }
+  }
+  std::sort(coded.begin(), coded.end(), [](std::pair<uint32_t, Tile> const &a, std::pair<uint32_t, Tile> const &b)
+            { return a.first < b.first; });
+
+  std::vector<Tile> tiles;
+  for (auto const &entry : coded)
+  {
+    tiles.push_back(entry.second);
   }
-  // Nettoyage de la mémoire allouée pour ce segment
-  delete segment; 
+  return tiles;
 }
 
-void Camera::render(Image &image, Scene &scene)
+/**
+ * Objects of the scene listed in the tiles their box covers on screen (the box is projected once per render).
+ * Unbounded objects, and boxes reaching behind the eye, are in every tile.
+ */
+struct TileObjects
 {
-  double ratio = (double)image.width / (double)image.height;
-  double height = 1.0 / ratio;
+  int x0;
+  int y0;
+  int columns;
+  int rows;
+  std::vector<std::vector<int>> tiles;
+  std::vector<int> everywhere;
 
-  double intervalX = 1.0 / (double)image.width;
-  double intervalY = height / (double)image.height;
+  void build(RenderSegment *segment, Scene &scene, int x0, int y0, int x1, int y1)
+  {
+    this->x0 = x0;
+    this->y0 = y0;
+    columns = (x1 - x0 + TILE_SIZE - 1) / TILE_SIZE;
+    rows = (y1 - y0 + TILE_SIZE - 1) / TILE_SIZE;
+    tiles.assign(columns * rows, std::vector<int>());
+    everywhere.clear();
 
-  scene.prepare();
+    std::vector<Bounds> const &bounds = scene.getObjectBounds();
+    for (int i = 0; i < bounds.size(); ++i)
+    {
+      Bounds const &box = bounds[i];
+      bool inFront = !box.empty();
+      double minX = INFINITY, minY = INFINITY, maxX = -INFINITY, maxY = -INFINITY;
+      for (int corner = 0; corner < 8 && inFront; ++corner)
+      {
+        Vector3 point(corner & 1 ? box.max[0] : box.min[0], corner & 2 ? box.max[1] : box.min[1],
+                      corner & 4 ? box.max[2] : box.min[2]);
+        double x, y;
+        inFront = projectPoint(segment, point, x, y);
+        if (!inFront)
+        {
+          break;
+        }
+        minX = std::min(minX, x);
+        minY = std::min(minY, y);
+        maxX = std::max(maxX, x);
+        maxY = std::max(maxY, y);
+      }
+      if (!inFront)
+      {
+        everywhere.push_back(i);
+        continue;
+      }
 
-#ifdef ENABLE_MULTITHREADING
-  // --- MODE MULTITHREADING ---
-  
-  // Détecter le nombre de coeurs logiques disponibles (ex: 8, 12, 16...)
-  unsigned int numThreads = std::thread::hardware_concurrency();
-  if (numThreads == 0) numThreads = 4; // Sécurité si la détection échoue
+      // Tiles overlapping the projected box, with a margin of one pixel for the rounding
+      int firstColumn = tileIndex(minX - 1 - x0, columns);
+      int lastColumn = tileIndex(maxX + 1 - x0, columns);
+      int firstRow = tileIndex(minY - 1 - y0, rows);
+      int lastRow = tileIndex(maxY + 1 - y0, rows);
+      for (int row = std::max(firstRow, 0); row <= std::min(lastRow, rows - 1); ++row)
+      {
+        for (int column = std::max(firstColumn, 0); column <= std::min(lastColumn, columns - 1); ++column)
+        {
+          tiles[row * columns + column].push_back(i);
+        }
+      }
+    }
+  }
 
-  std::vector<std::thread> threads;
-  int rowsPerThread = image.height / numThreads;
+  /**
+   * Tile of a pixel coordinate, between -1 and count (outside of the grid)
+   */
+  static int tileIndex(double position, int count)
+  {
+    return (int)std::floor(std::max(-1.0, std::min((double)count, position / TILE_SIZE)));
+  }
 
-  std::cout << "Rendering with " << numThreads << " threads..." << std::endl;
+  /**
+   * Objects that may be seen in the tile, in the order of the scene
+   */
+  void candidates(Tile const &tile, std::vector<int> &out) const
+  {
+    std::vector<int> const &listed = tiles[tile.row * columns + tile.column];
+    out.clear();
+    std::merge(listed.begin(), listed.end(), everywhere.begin(), everywhere.end(), std::back_inserter(out));
+  }
+};
 
-  for (unsigned int i = 0; i < numThreads; ++i)
+/**
+ * Renders the pixels of a tile of the frame in Z-order, into the image of the segment
+ * (pixel (x, y) of the frame goes to (x - offsetX, y - offsetY)).
+ * With tile culling, tileObjects gives the objects of the tile.
+ */
+static void renderTile(RenderSegment *segment, Tile const &tile, int offsetX, int offsetY, TileObjects const &tileObjects)
+{
+  SceneBuckets visible;
+  SceneBuckets *objects = NULL;
+  bool empty = false;
+  if (segment->scene->tileCulling)
   {
-    // Préparation des données pour le thread
-    RenderSegment *seg = new RenderSegment();
-    seg->height = height;
-    seg->image = &image;
-    seg->scene = &scene;
-    seg->intervalX = intervalX;
-    seg->intervalY = intervalY;
-    seg->reflections = Reflections;
+    std::vector<int> candidates;
+    tileObjects.candidates(tile, candidates);
+    if (candidates.empty())
+    {
+      empty = true;
+    }
+    else
+    {
+      // Pyramid of the rays through the tile, edges included (sub-pixel offsets stay inside)
+      Vector3 corners[4] = {primaryDirection(segment, tile.x0, tile.y0), primaryDirection(segment, tile.x1, tile.y0),
+                            primaryDirection(segment, tile.x1, tile.y1), primaryDirection(segment, tile.x0, tile.y1)};
+      empty = segment->scene->cullObjects(primaryOrigin(segment), corners, candidates, visible) == 0;
+      objects = &visible;
+    }
+  }
 
-    // Découpage : on assigne une tranche de lignes à chaque thread
-    seg->rowMin = i * rowsPerThread;
-    
-    // Si c'est le dernier thread, il prend tout ce qu'il reste (pour gérer les divisions impaires)
-    if (i == numThreads - 1) {
-        seg->rowMax = image.height;
-    } else {
-        seg->rowMax = (i + 1) * rowsPerThread;
+  if (empty)
+  {
+    // Nothing to hit: the background
+    for (int y = tile.y0; y < tile.y1; ++y)
+    {
+      for (int x = tile.x0; x < tile.x1; ++x)
+      {
+        segment->image->setPixel(x - offsetX, y - offsetY, Color());
+      }
     }
+    return;
+  }
 
-    // Lancement du thread
-    threads.emplace_back(renderSegment, seg);
+  // Directions of the whole tile, row by row
+  Vector3 directions[TILE_SIZE * TILE_SIZE];
+  for (int y = tile.y0; y < tile.y1; ++y)
+  {
+    segment->rays.directions(y, tile.x0, tile.x1, directions + (y - tile.y0) * TILE_SIZE);
   }
 
-  // Attendre que tous les threads aient fini (Join)
-  for (auto &t : threads)
+  for (TilePixel const &pixel : tilePixels())
   {
-    if (t.joinable()) {
-      t.join();
+    int dx = pixel.dx;
+    int dy = pixel.dy;
+    int x = tile.x0 + dx;
+    int y = tile.y0 + dy;
+    if (x >= tile.x1 || y >= tile.y1)
+    {
+      continue;
     }
+    segment->image->setPixel(x - offsetX, y - offsetY, tracePrimary(segment, directions[dy * TILE_SIZE + dx], objects));
   }
+}
 
+void Camera::render(Image &image, Scene &scene)
+{
+  RenderSegment seg = frameSegment(*this, image.width, image.height, &image, &scene, Reflections);
+
+  scene.prepare();
+
+#ifdef ENABLE_MULTITHREADING
+  std::cout << "Rendering with " << ThreadPool::shared().size() + 1 << " threads..." << std::endl;
 #else
-  // --- MODE SINGLE THREAD (CODE D'ORIGINE) ---
   std::cout << "Rendering single-threaded..." << std::endl;
-  RenderSegment *seg = new RenderSegment();
-  seg->height = height;
-  seg->image = &image;
-  seg->scene = &scene;
-  seg->intervalX = intervalX;
-  seg->intervalY = intervalY;
-  seg->reflections = Reflections;
-  seg->rowMin = 0;
-  seg->rowMax = image.height;
-  
-  renderSegment(seg);
 #endif
+
+  std::vector<Tile> tiles = mortonTiles(0, 0, image.width, image.height);
+  TileObjects tileObjects;
+  if (scene.tileCulling)
+  {
+    tileObjects.build(&seg, scene, 0, 0, image.width, image.height);
+  }
+  forEachRow(tiles.size(), [&](int i)
+             {
+    renderTile(&seg, tiles[i], 0, 0, tileObjects);
+    return true; });
+}
+
+/**
+ * Radical inverse of i in the given base: low-discrepancy sub-pixel offsets in [0, 1).
+ */
+double halton(int i, int base)
+{
+  double f = 1;
+  double r = 0;
+  while (i > 0)
+  {
+    f = f / base;
+    r = r + f * (i % base);
+    i = i / base;
+  }
+  return r;
+}
+
+// Rows rendered between two checks for a preview
+static const int PREVIEW_BATCH = 32;
+
+int Camera::renderProgressive(Image &image, Scene &scene, ProgressiveSettings const &settings)
+{
+  RenderSegment seg = frameSegment(*this, image.width, image.height, &image, &scene, Reflections);
+
+  scene.prepare();
+
+  int width = image.width;
+  int height = image.height;
+  std::vector<float> sums(width * height * 3, 0.0f);
+  std::vector<int> counts(width * height, 0);
+
+  auto start = std::chrono::steady_clock::now();
+  auto elapsed = [&]()
+  {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  };
+
+  std::atomic<bool> stopped(false);
+  auto shouldStop = [&]()
+  {
+    if ((settings.cancel != nullptr && settings.cancel->load()) ||
+        (settings.maxTime > 0 && elapsed() > settings.maxTime))
+    {
+      stopped = true;
+    }
+    return stopped.load();
+  };
+
+  // Only called between two batches of rows: no thread is writing to the image
+  double nextPreview = settings.previewInterval;
+  auto maybePreview = [&]()
+  {
+    double now = elapsed();
+    if (now >= nextPreview)
+    {
+      nextPreview = now + settings.previewInterval;
+      settings.preview(image);
+    }
+  };
+
+  // With previews, rows are rendered in batches, with a chance for a preview after each batch
+  bool previews = settings.previewInterval > 0 && settings.preview;
+  auto renderRows = [&](int rows, auto renderRow)
+  {
+    if (!previews)
+    {
+      forEachRow(rows, renderRow);
+      return;
+    }
+    for (int first = 0; first < rows && !stopped; first += PREVIEW_BATCH)
+    {
+      forEachRow(std::min(PREVIEW_BATCH, rows - first), [&](int i)
+                 { return renderRow(first + i); });
+      maybePreview();
+    }
+  };
+
+  // Coarse passes: one sample for each block of step x step pixels, then refined
+  for (int step = 8; step >= 1 && !stopped; step /= 2)
+  {
+    renderRows((height + step - 1) / step, [&](int row)
+               {
+      if (shouldStop())
+      {
+        return false;
+      }
+      int y = row * step;
+      for (int x = 0; x < width; x += step)
+      {
+        // Already traced by the previous (coarser) pass
+        if (step < 8 && x % (2 * step) == 0 && y % (2 * step) == 0)
+        {
+          continue;
+        }
+
+        Color pixel = tracePrimary(&seg, x, y);
+        int index = y * width + x;
+        sums[index * 3] = pixel.r;
+        sums[index * 3 + 1] = pixel.g;
+        sums[index * 3 + 2] = pixel.b;
+        counts[index] = 1;
+
+        for (int by = y; by < std::min(y + step, height); ++by)
+        {
+          for (int bx = x; bx < std::min(x + step, width); ++bx)
+          {
+            image.setPixel(bx, by, pixel);
+          }
+        }
+      }
+      return true; });
+  }
+
+  int samples = 0;
+  if (!stopped)
+  {
+    samples = 1;
+    std::printf("Pass 1 spp done at %.3f seconds.\n", elapsed());
+  }
+
+  // Sample passes: one more jittered sample per pixel each time
+  for (int sample = 1; sample < settings.samples && !stopped; ++sample)
+  {
+    double dx = halton(sample, 2);
+    double dy = halton(sample, 3);
+    PrimaryRays rays = primaryRays(&seg, width, height, dx, dy);
+
+    renderRows(height, [&](int y)
+               {
+      if (shouldStop())
+      {
+        return false;
+      }
+      std::vector<Vector3> directions(width);
+      rays.directions(y, 0, width, directions.data());
+      for (int x = 0; x < width; ++x)
+      {
+        Color pixel = tracePrimary(&seg, directions[x]);
+        int index = y * width + x;
+        sums[index * 3] += pixel.r;
+        sums[index * 3 + 1] += pixel.g;
+        sums[index * 3 + 2] += pixel.b;
+        counts[index]++;
+
+        float n = counts[index];
+        image.setPixel(x, y, Color(sums[index * 3] / n, sums[index * 3 + 1] / n, sums[index * 3 + 2] / n));
+      }
+      return true; });
+
+    if (!stopped)
+    {
+      samples = sample + 1;
+      std::printf("Pass %d spp done at %.3f seconds.\n", samples, elapsed());
+    }
+  }
+
+  if (stopped)
+  {
+    std::printf("Stopped at %.3f seconds, keeping the image so far.\n", elapsed());
+  }
+  return samples;
+}
+
+RenderQuality Camera::renderBudgeted(Image &image, Scene &scene, double budget, ProgressiveSettings settings)
+{
+  auto start = std::chrono::steady_clock::now();
+  auto elapsed = [&]()
+  {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  };
+
+  RenderSegment seg = frameSegment(*this, image.width, image.height, &image, &scene, Reflections);
+
+  scene.prepare();
+
+  // Calibration on one pixel out of 8x8, spread over the whole image
+  const int step = 8;
+  int calibrationRows = (image.height + step - 1) / step;
+  int calibrationPixels = calibrationRows * ((image.width + step - 1) / step);
+
+  auto measure = [&](int reflections)
+  {
+    seg.reflections = reflections;
+    double begin = elapsed();
+    forEachRow(calibrationRows, [&](int row)
+               {
+      for (int x = 0; x < image.width; x += step)
+      {
+        image.setPixel(x, row * step, tracePrimary(&seg, x, row * step));
+      }
+      return true; });
+    return (elapsed() - begin) / calibrationPixels;
+  };
+
+  // Cost of a sample without any reflection, and with all of them (last, so the image keeps them)
+  double costMin = Reflections > 0 ? measure(0) : 0;
+  double costMax = measure(Reflections);
+  if (Reflections == 0)
+  {
+    costMin = costMax;
+  }
+
+  auto costPerSample = [&](int reflections)
+  {
+    if (Reflections == 0)
+    {
+      return costMax;
+    }
+    return costMin + (costMax - costMin) * reflections / Reflections;
+  };
+
+  // Keep a margin for the estimation error and the preview snapshots
+  double remaining = (budget - elapsed()) * 0.9;
+  double pixels = (double)image.width * (double)image.height;
+
+  RenderQuality quality;
+  quality.reflections = Reflections;
+  while (quality.reflections > 0 && costPerSample(quality.reflections) * pixels > remaining)
+  {
+    quality.reflections--;
+  }
+  double perPass = costPerSample(quality.reflections) * pixels;
+  quality.samples = std::max(1, std::min(settings.samples, (int)(remaining / std::max(perPass, 1e-12))));
+
+  std::printf("Measured %.3f us per sample (%.3f us without reflections), rendering with %d spp and %d reflections.\n",
+              costMax * 1e6, costMin * 1e6, quality.samples, quality.reflections);
+
+  double left = budget - elapsed();
+  if (left <= 0)
+  {
+    // No time left for a pass (maxTime 0 would mean no limit): keep the calibration pixels, one per block
+    for (int y = 0; y < image.height; ++y)
+    {
+      for (int x = 0; x < image.width; ++x)
+      {
+        image.setPixel(x, y, image.getPixel(x - x % step, y - y % step));
+      }
+    }
+    std::printf("Budget used by the calibration, keeping its image.\n");
+    quality.samples = 0;
+    return quality;
+  }
+
+  int maxReflections = Reflections;
+  Reflections = quality.reflections;
+  settings.samples = quality.samples;
+  settings.maxTime = settings.maxTime > 0 ? std::min(settings.maxTime, left) : left;
+  int samples = renderProgressive(image, scene, settings);
+  Reflections = maxReflections;
+
+  quality.samples = samples;
+  return quality;
+}
+
+void Camera::renderRegion(Image &tile, Scene &scene, unsigned int frameWidth, unsigned int frameHeight,
+                          unsigned int x0, unsigned int y0)
+{
+  RenderSegment seg = frameSegment(*this, frameWidth, frameHeight, &tile, &scene, Reflections);
+
+  scene.prepare();
+
+  std::vector<Tile> tiles = mortonTiles(x0, y0, x0 + tile.width, y0 + tile.height);
+  TileObjects tileObjects;
+  if (scene.tileCulling)
+  {
+    tileObjects.build(&seg, scene, x0, y0, x0 + tile.width, y0 + tile.height);
+  }
+  forEachRow(tiles.size(), [&](int i)
+             {
+    renderTile(&seg, tiles[i], x0, y0, tileObjects);
+    return true; });
 }
 
 std::ostream &operator<<(std::ostream &_stream, Camera &cam)
@@ -1,10 +1,37 @@
 #pragma once
 
 #include <iostream>
+#include <atomic>
+#include <functional>
 #include "../raymath/Vector3.hpp"
 #include "../rayimage/Image.hpp"
 #include "../rayscene/Scene.hpp"
 
+/**
+ * Settings of a progressive render (see Camera::renderProgressive).
+ */
+struct ProgressiveSettings
+{
+  // Samples per pixel of the last pass
+  int samples = 16;
+  // Seconds between two calls to preview (0 = no preview)
+  double previewInterval = 0;
+  std::function<void(Image &)> preview;
+  // Seconds after which the render stops (0 = no limit)
+  double maxTime = 0;
+  // Set from another thread (or a signal handler) to stop the render
+  std::atomic<bool> *cancel = nullptr;
+};
+
+/**
+ * Quality chosen to fit a time budget (see Camera::renderBudgeted).
+ */
+struct RenderQuality
+{
+  int samples = 1;
+  int reflections = 0;
+};
+
 class Camera
 {
 private:
@@ -17,10 +44,42 @@ public:
 
   int Reflections = 0;
 
+  // The camera looks from its position towards lookAt, up giving the vertical of the image
+  Vector3 lookAt = Vector3(0, 0, 0);
+  Vector3 up = Vector3(0, 1, 0);
+  // Horizontal field of view in degrees. 0: image plane 1 unit wide at distance 1 (about 53 degrees)
+  double fov = 0;
+  // Width / height of the image plane (0: the one of the image)
+  double aspect = 0;
+
   Vector3 getPosition();
   void setPosition(Vector3 &pos);
 
   void render(Image &image, Scene &scene);
 
+  /**
+   * Renders the image in passes: coarse passes (blocks of 8, 4, 2 pixels) up to one sample
+   * per pixel, then one more sample per pixel at each pass.
+   * The image always holds the best result so far, even when the render is stopped early.
+   * Returns the number of samples per pixel of the last complete pass (0 if stopped during the coarse passes).
+   */
+  int renderProgressive(Image &image, Scene &scene, ProgressiveSettings const &settings);
+
+  /**
+   * Renders only a tile of a frameWidth x frameHeight image, with (x0, y0) its top left corner.
+   * The pixels are identical to the ones of a full render.
+   */
+  void renderRegion(Image &tile, Scene &scene, unsigned int frameWidth, unsigned int frameHeight,
+                    unsigned int x0, unsigned int y0);
+
+  /**
+   * Renders within a time budget (seconds): the throughput is first measured on a sparse grid
+   * of pixels, then the samples per pixel (up to settings.samples) and the reflection depth
+   * (up to Reflections) are chosen to finish in time. The render itself is progressive,
+   * and stops at the end of the budget if the estimate was too optimistic. If the measure
+   * used up the budget, the image is the measured grid (samples is then 0).
+   */
+  RenderQuality renderBudgeted(Image &image, Scene &scene, double budget, ProgressiveSettings settings);
+
   friend std::ostream &operator<<(std::ostream &_stream, Vector3 const &vec);
 };
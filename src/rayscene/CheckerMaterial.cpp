@@ -8,6 +8,7 @@
 
 CheckerMaterial::CheckerMaterial()
 {
+  type = MATERIAL_CHECKER;
 }
 
 CheckerMaterial::~CheckerMaterial()
@@ -1,23 +1,43 @@
 #pragma once
 
+#include <cmath>
 #include "../raymath/Vector3.hpp"
 #include "../raymath/Color.hpp"
 #include "../raymath/Ray.hpp"
+#include "Material.hpp"
 
-class Material;
+class SceneObject;
 
+/**
+ * Candidate hit recorded during traversal. The full Intersection is only built
+ * for the closest one, by SceneObject::fillIntersection.
+ */
+struct Hit
+{
+  // Hit point = ray position + ray direction * t.
+  // Before a hit is found, it is the end of the ray: primitives only accept hits in ]0, t[
+  double t = INFINITY;
+  // Primitive hit (the triangle, for a mesh)
+  SceneObject *primitive = nullptr;
+  // Barycentric coordinates of the hit point, relative to B and C (triangles only)
+  float u = 0;
+  float v = 0;
+
+  Vector3 position(Ray &r) const { return r.GetPosition() + (r.GetDirection() * t); }
+};
+
+/**
+ * Shading record of the closest hit.
+ */
 class Intersection
 {
 public:
   Vector3 Position;
   Vector3 Normal;
   float Distance;
-  Ray SourceRay;
   Vector3 View;
-  Material *Mat;
+  MaterialId MatId;
 
   Intersection();
   ~Intersection();
-
-  Intersection &operator=(Intersection const &inters);
 };
@@ -2,6 +2,7 @@
 #include "Light.hpp"
 #include "../raymath/Vector3.hpp"
 #include "../raymath/Color.hpp"
+#include <cmath>
 
 Light::Light(Vector3 c) : center(c)
 {
@@ -15,3 +16,41 @@ Vector3 Light::GetPosition()
 {
   return center;
 }
+
+
+void LightBuffer::build(std::vector<Light *> const &lights)
+{
+  int n = lights.size();
+  x.resize(n);
+  y.resize(n);
+  z.resize(n);
+  diffuse.resize(n);
+  specular.resize(n);
+  for (int i = 0; i < n; ++i)
+  {
+    Vector3 p = lights[i]->GetPosition();
+    x[i] = p.x;
+    y[i] = p.y;
+    z[i] = p.z;
+    diffuse[i] = lights[i]->Diffuse;
+    specular[i] = lights[i]->Specular;
+  }
+}
+
+void LightBuffer::directions(Vector3 const &point, int begin, int count, double *dx, double *dy, double *dz) const
+{
+  const double *lx = x.data() + begin;
+  const double *ly = y.data() + begin;
+  const double *lz = z.data() + begin;
+  for (int i = 0; i < count; ++i)
+  {
+    double vx = lx[i] - point.x;
+    double vy = ly[i] - point.y;
+    double vz = lz[i] - point.z;
+    double l = std::sqrt(vx * vx + vy * vy + vz * vz);
+    // A light exactly on the point gives a null direction, like Vector3::normalize
+    dx[i] = l == 0 ? 0 : vx / l;
+    dy[i] = l == 0 ? 0 : vy / l;
+    dz[i] = l == 0 ? 0 : vz / l;
+  }
+}
@@ -3,6 +3,7 @@
 #include "../raymath/Vector3.hpp"
 #include "../raymath/Color.hpp"
 #include "../raymath/Ray.hpp"
+#include <vector>
 
 class Light
 {
@@ -18,3 +19,27 @@ public:
 
   Vector3 GetPosition();
 };
+
+/**
+ * Lights of a scene packed in arrays (positions split by axis), built by Scene::prepare().
+ */
+struct LightBuffer
+{
+  // Number of lights whose direction is computed at once, on the stack of the shading code
+  static constexpr int BLOCK = 16;
+
+  std::vector<double> x;
+  std::vector<double> y;
+  std::vector<double> z;
+  std::vector<Color> diffuse;
+  std::vector<Color> specular;
+
+  void build(std::vector<Light *> const &lights);
+  int size() const { return (int)x.size(); }
+
+  /**
+   * Normalized directions from the point to the lights [begin, begin + count[, count <= BLOCK.
+   * Same result as (light->GetPosition() - point).normalize(), without branches so the loop vectorizes.
+   */
+  void directions(Vector3 const &point, int begin, int count, double *dx, double *dy, double *dz) const;
+};
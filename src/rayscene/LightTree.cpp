@@ -0,0 +1,151 @@
+#include <algorithm>
+#include <cmath>
+#include "LightTree.hpp"
+
+void LightTree::build(LightBuffer const &lights)
+{
+  nodes.clear();
+  if (lights.size() == 0)
+  {
+    return;
+  }
+  nodes.reserve(2 * lights.size() - 1);
+
+  std::vector<int> order(lights.size());
+  for (int i = 0; i < lights.size(); ++i)
+  {
+    order[i] = i;
+  }
+  build(lights, order, 0, lights.size());
+}
+
+int LightTree::build(LightBuffer const &lights, std::vector<int> &order, int begin, int end)
+{
+  int index = nodes.size();
+  nodes.push_back(Node());
+
+  Node node;
+  for (int axis = 0; axis < 3; ++axis)
+  {
+    node.min[axis] = INFINITY;
+    node.max[axis] = -INFINITY;
+  }
+  for (int i = begin; i < end; ++i)
+  {
+    int l = order[i];
+    double p[3] = {lights.x[l], lights.y[l], lights.z[l]};
+    for (int axis = 0; axis < 3; ++axis)
+    {
+      node.min[axis] = std::min(node.min[axis], p[axis]);
+      node.max[axis] = std::max(node.max[axis], p[axis]);
+    }
+  }
+
+  if (end - begin == 1)
+  {
+    int l = order[begin];
+    Color const &d = lights.diffuse[l];
+    Color const &s = lights.specular[l];
+    node.diffuse = (d.r + d.g + d.b) / 3;
+    node.specular = (s.r + s.g + s.b) / 3;
+    node.light = l;
+    nodes[index] = node;
+    return index;
+  }
+
+  // Median split along the largest extent of the box
+  int axis = 0;
+  for (int a = 1; a < 3; ++a)
+  {
+    if (node.max[a] - node.min[a] > node.max[axis] - node.min[axis])
+    {
+      axis = a;
+    }
+  }
+  std::vector<double> const &coords = axis == 0 ? lights.x : (axis == 1 ? lights.y : lights.z);
+  int middle = (begin + end) / 2;
+  std::nth_element(order.begin() + begin, order.begin() + middle, order.begin() + end,
+                   [&coords](int a, int b)
+                   { return coords[a] < coords[b]; });
+
+  node.left = build(lights, order, begin, middle);
+  node.right = build(lights, order, middle, end);
+  node.diffuse = nodes[node.left].diffuse + nodes[node.right].diffuse;
+  node.specular = nodes[node.left].specular + nodes[node.right].specular;
+  nodes[index] = node;
+  return index;
+}
+
+/**
+ * Largest cosine between axis and a direction from the point towards a sphere (0 if all are beyond 90 degrees).
+ */
+static double maxCosine(Vector3 const &axis, Vector3 const &toCenter, double distance, double radius)
+{
+  if (distance <= radius)
+  {
+    return 1;
+  }
+
+  // Cone from the point around the sphere
+  double sinBound = radius / distance;
+  double cosBound = std::sqrt(1 - sinBound * sinBound);
+  double cosTheta = axis.dot(toCenter) / distance;
+  if (cosTheta >= cosBound)
+  {
+    return 1;
+  }
+  double sinTheta = std::sqrt(std::max(0.0, 1 - cosTheta * cosTheta));
+  return std::max(0.0, cosTheta * cosBound + sinTheta * sinBound);
+}
+
+float LightTree::importance(Node const &node, Vector3 const &point, Vector3 const &normal, Vector3 const &reflected) const
+{
+  Vector3 center((node.min[0] + node.max[0]) / 2, (node.min[1] + node.max[1]) / 2, (node.min[2] + node.max[2]) / 2);
+  Vector3 halfDiagonal((node.max[0] - node.min[0]) / 2, (node.max[1] - node.min[1]) / 2, (node.max[2] - node.min[2]) / 2);
+  double radius = halfDiagonal.length();
+
+  Vector3 toCenter = center - point;
+  double distance = toCenter.length();
+  return node.diffuse * maxCosine(normal, toCenter, distance, radius) +
+         node.specular * maxCosine(reflected, toCenter, distance, radius);
+}
+
+int LightTree::sample(Vector3 const &point, Vector3 const &normal, Vector3 const &view, double u, double &pdf) const
+{
+  pdf = 1;
+  if (nodes.empty())
+  {
+    return -1;
+  }
+
+  // The specular term of a light is its cosine with the view reflected on the surface
+  Vector3 reflected = (view * -1).reflect(normal);
+
+  int index = 0;
+  while (nodes[index].light < 0)
+  {
+    Node const &node = nodes[index];
+    float left = importance(nodes[node.left], point, normal, reflected);
+    float right = importance(nodes[node.right], point, normal, reflected);
+    if (left + right <= 0)
+    {
+      return -1;
+    }
+
+    // u is rescaled at each level so it can be reused down the tree
+    double pLeft = left / (left + right);
+    if (u < pLeft)
+    {
+      u = u / pLeft;
+      pdf *= pLeft;
+      index = node.left;
+    }
+    else
+    {
+      u = std::min((u - pLeft) / (1 - pLeft), 0.999999);
+      pdf *= 1 - pLeft;
+      index = node.right;
+    }
+  }
+  return nodes[index].light;
+}
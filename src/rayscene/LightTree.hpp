@@ -0,0 +1,49 @@
+#pragma once
+
+#include <vector>
+#include "../raymath/Vector3.hpp"
+#include "Light.hpp"
+
+/**
+ * Binary hierarchy over the point lights of a scene, used to sample one light
+ * proportionally to its estimated contribution at a shading point.
+ * Each node keeps the bounding box of its lights and the sums of their diffuse and specular intensities.
+ */
+class LightTree
+{
+private:
+  struct Node
+  {
+    double min[3];
+    double max[3];
+    float diffuse = 0;
+    float specular = 0;
+    // Children indices for an inner node, light index in `light` for a leaf (right = -1)
+    int left = -1;
+    int right = -1;
+    int light = -1;
+  };
+
+  std::vector<Node> nodes;
+
+  int build(LightBuffer const &lights, std::vector<int> &order, int begin, int end);
+
+  /**
+   * Upper bound of the contribution of a node at a point: its diffuse intensity times the largest
+   * cosine between the normal and a direction towards its bounding box, plus its specular intensity
+   * times the largest cosine with the reflected view. It is 0 only for the lights the exact shading
+   * skips (behind the surface and outside of the specular lobe).
+   */
+  float importance(Node const &node, Vector3 const &point, Vector3 const &normal, Vector3 const &reflected) const;
+
+public:
+  void build(LightBuffer const &lights);
+  bool empty() const { return nodes.empty(); }
+
+  /**
+   * Picks a light from u in [0, 1[, for a point seen from the direction view (towards the eye).
+   * Returns the light index and the probability of having picked it in pdf, or -1 when the walk reaches
+   * a node whose lights cannot contribute (the bounds of its parent are conservative): a null sample.
+   */
+  int sample(Vector3 const &point, Vector3 const &normal, Vector3 const &view, double u, double &pdf) const;
+};
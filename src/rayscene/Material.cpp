@@ -1,4 +1,5 @@
 #include <iostream>
+#include <functional>
 #include "Material.hpp"
 #include "Intersection.hpp"
 #include "Scene.hpp"
@@ -15,4 +16,19 @@ Color Material::render(Ray &r, Ray &camera, Intersection *intersection, Scene *s
 {
   Color black;
   return black;
-}
\ No newline at end of file
+}
+
+bool Material::equals(Material const &other) const
+{
+  return type == other.type && cReflection == other.cReflection;
+}
+
+size_t Material::combineHash(size_t seed, float value)
+{
+  return seed ^ (std::hash<float>()(value) + 0x9e3779b9 + (seed << 6) + (seed >> 2));
+}
+
+size_t Material::hash() const
+{
+  return combineHash(type, cReflection);
+}
@@ -1,17 +1,48 @@
 #pragma once
 #include "../raymath/Ray.hpp"
 #include "../raymath/Color.hpp"
+#include <cstddef>
+#include <cstdint>
 
 class Scene;
 class Intersection;
 
+/**
+ * Index of a material in the material table of the scene
+ */
+typedef uint32_t MaterialId;
+const MaterialId NO_MATERIAL = 0xffffffff;
+
+/**
+ * Known material types: shading switches over them instead of using virtual calls
+ */
+enum MaterialType
+{
+  MATERIAL_BLACK,
+  MATERIAL_PHONG,
+  MATERIAL_CHECKER
+};
+
 class Material
 {
-private:
+protected:
+  static size_t combineHash(size_t seed, float value);
+
 public:
+  MaterialType type = MATERIAL_BLACK;
   float cReflection = 0;
 
   Material();
-  ~Material();
+  virtual ~Material();
   virtual Color render(Ray &r, Ray &camera, Intersection *intersection, Scene *scene);
+
+  /**
+   * Same type and same properties (used to deduplicate the materials of a scene)
+   */
+  virtual bool equals(Material const &other) const;
+
+  /**
+   * Hash of the same properties: equal materials have the same hash
+   */
+  virtual size_t hash() const;
 };
@@ -1,8 +1,8 @@
 #include <iostream>
 #include "Mesh.hpp"
 #include "../raymath/Vector3.hpp"
-#include "../objloader/OBJ_Loader.h"
-#include <limits>
+#include "ObjCache.hpp"
+#include <cmath>
 
 Mesh::Mesh() : SceneObject()
 {
@@ -10,132 +10,139 @@ Mesh::Mesh() : SceneObject()
 
 Mesh::~Mesh()
 {
-    for (int i = 0; i < triangles.size(); ++i)
-    {
-        delete triangles[i];
-    }
+    // The triangles belong to the arena
 }
 
-void Mesh::loadFromObj(std::string path)
+void Mesh::loadFromObj(std::string path, Arena &arena)
 {
+    setGeometry(*ObjCache::shared().load(path), arena);
+}
 
-    objl::Loader *loader = new objl::Loader();
-    bool loadout = loader->LoadFile(path);
-
-    if (loadout)
+void Mesh::setGeometry(MeshGeometry const &geometry, Arena &arena)
+{
+    size_t count = geometry.vertices.size() / 3;
+    triangles.reserve(triangles.size() + count);
+
+    // All the triangles of the mesh are contiguous
+    Triangle *block = arena.createArray<Triangle>(count, [&geometry](size_t i, Triangle *memory)
+                                                  {
+                                                      int j = i * 3;
+                                                      Triangle *triangle = new (memory) Triangle(
+                                                          geometry.vertices[j],
+                                                          geometry.vertices[j + 1],
+                                                          geometry.vertices[j + 2]);
+                                                      triangle->name = "T:" + std::to_string(j);
+                                                      triangle->ID = j; });
+    for (size_t i = 0; i < count; ++i)
     {
-        for (int i = 0; i < loader->LoadedMeshes.size(); i++)
-        {
-            objl::Mesh curMesh = loader->LoadedMeshes[i];
-
-            for (int j = 0; j < curMesh.Indices.size(); j += 3)
-            {
-                Vector3 v1(
-                    curMesh.Vertices[curMesh.Indices[j]].Position.X,
-                    curMesh.Vertices[curMesh.Indices[j]].Position.Y,
-                    curMesh.Vertices[curMesh.Indices[j]].Position.Z);
-                Vector3 v2(
-                    curMesh.Vertices[curMesh.Indices[j + 1]].Position.X,
-                    curMesh.Vertices[curMesh.Indices[j + 1]].Position.Y,
-                    curMesh.Vertices[curMesh.Indices[j + 1]].Position.Z);
-                Vector3 v3(
-                    curMesh.Vertices[curMesh.Indices[j + 2]].Position.X,
-                    curMesh.Vertices[curMesh.Indices[j + 2]].Position.Y,
-                    curMesh.Vertices[curMesh.Indices[j + 2]].Position.Z);
-
-                Triangle *triangle = new Triangle(
-                    v1,
-                    v2,
-                    v3);
-                triangle->name = "T:" + std::to_string(j);
-                triangle->ID = j;
-                triangles.push_back(triangle);
-            }
-        }
+        triangles.push_back(block + i);
     }
-
-    this->applyTransform();
-    delete loader;
 }
 
 void Mesh::applyTransform()
 {
-    // Initialisation des limites
-    double minDouble = std::numeric_limits<double>::lowest();
-    double maxDouble = std::numeric_limits<double>::max();
-    
-    Vector3 minPoint(maxDouble, maxDouble, maxDouble);
-    Vector3 maxPoint(minDouble, minDouble, minDouble);
-
+    std::vector<Bounds> bounds(triangles.size());
+    // Only the spatial splits need the triangles themselves
+    std::vector<Vector3> corners;
+    if (bvhSettings.method == BVH_BUILD_SBVH)
+    {
+        corners.reserve(3 * triangles.size());
+    }
     for (int i = 0; i < triangles.size(); ++i)
     {
-        triangles[i]->material = this->material;
+        triangles[i]->materialId = this->materialId;
         triangles[i]->transform = transform;
         triangles[i]->applyTransform();
 
-        // --- CORRECTION ICI : Utilisez tA, tB, tC ---
-        Vector3 v1 = triangles[i]->tA;
-        Vector3 v2 = triangles[i]->tB;
-        Vector3 v3 = triangles[i]->tC;
-
-        // Le reste de la logique reste identique...
-        if (v1.x < minPoint.x) minPoint.x = v1.x;
-        if (v1.y < minPoint.y) minPoint.y = v1.y;
-        if (v1.z < minPoint.z) minPoint.z = v1.z;
-        
-        // ... (Faites pareil pour v2 et v3 et pour le maxPoint) ...
-        // Je vous remets le bloc complet pour éviter les erreurs :
-        
-        if (v2.x < minPoint.x) minPoint.x = v2.x;
-        if (v2.y < minPoint.y) minPoint.y = v2.y;
-        if (v2.z < minPoint.z) minPoint.z = v2.z;
-
-        if (v3.x < minPoint.x) minPoint.x = v3.x;
-        if (v3.y < minPoint.y) minPoint.y = v3.y;
-        if (v3.z < minPoint.z) minPoint.z = v3.z;
-
-        // Max
-        if (v1.x > maxPoint.x) maxPoint.x = v1.x;
-        if (v1.y > maxPoint.y) maxPoint.y = v1.y;
-        if (v1.z > maxPoint.z) maxPoint.z = v1.z;
-
-        if (v2.x > maxPoint.x) maxPoint.x = v2.x;
-        if (v2.y > maxPoint.y) maxPoint.y = v2.y;
-        if (v2.z > maxPoint.z) maxPoint.z = v2.z;
+        bounds[i].grow(triangles[i]->tA);
+        bounds[i].grow(triangles[i]->tB);
+        bounds[i].grow(triangles[i]->tC);
+        if (bvhSettings.method == BVH_BUILD_SBVH)
+        {
+            corners.push_back(triangles[i]->tA);
+            corners.push_back(triangles[i]->tB);
+            corners.push_back(triangles[i]->tC);
+        }
+    }
+    bvh.build(bounds, bvhSettings, &corners);
 
-        if (v3.x > maxPoint.x) maxPoint.x = v3.x;
-        if (v3.y > maxPoint.y) maxPoint.y = v3.y;
-        if (v3.z > maxPoint.z) maxPoint.z = v3.z;
+    box = Bounds();
+    for (Bounds const &triangle : bounds)
+    {
+        box.grow(triangle);
     }
-    
-    this->box = AABB(minPoint, maxPoint);
 }
-bool Mesh::intersects(Ray &r, Intersection &intersection, CullingType culling)
+
+template <CullingType Culling, QueryType Query>
+bool Mesh::traverse(Ray &r, Hit &hit)
 {
-    if (!box.intersects(r)) return false;
-    Intersection tInter;
+    bool found = false;
+    // Index of the triangle of the closest hit: the BVH visits the triangles out of order,
+    // so on equal distances the first triangle of the mesh wins, as with a linear loop
+    int hitIndex = -1;
+    bvh.traverse(r, hit.t, [&](int first, int count)
+                 {
+                     for (int k = first; k < first + count; ++k)
+                     {
+                         int index = bvh.order[k];
+                         if (Query == QUERY_ANY)
+                         {
+                             if (triangles[index]->hitTest<Culling, Query>(r, hit))
+                             {
+                                 found = true;
+                                 return true;
+                             }
+                             continue;
+                         }
+
+                         Hit candidate = hit;
+                         candidate.t = std::nextafter(hit.t, INFINITY);
+                         if (triangles[index]->hitTest<Culling, Query>(r, candidate) &&
+                             (candidate.t < hit.t || index < hitIndex))
+                         {
+                             hit = candidate;
+                             hitIndex = index;
+                             found = true;
+                         }
+                     }
+                     return false; });
+    return found;
+}
 
-    double closestDistance = -1;
-    Intersection closestInter;
-    for (int i = 0; i < triangles.size(); ++i)
+bool Mesh::intersects(Ray &r, Hit &hit, CullingType culling)
+{
+    switch (culling)
     {
-        if (triangles[i]->intersects(r, tInter, culling))
-        {
-
-            tInter.Distance = (tInter.Position - r.GetPosition()).length();
-            if (closestDistance < 0 || tInter.Distance < closestDistance)
-            {
-                closestDistance = tInter.Distance;
-                closestInter = tInter;
-            }
-        }
+    case CULLING_FRONT:
+        return traverse<CULLING_FRONT, QUERY_CLOSEST>(r, hit);
+    case CULLING_BACK:
+        return traverse<CULLING_BACK, QUERY_CLOSEST>(r, hit);
+    default:
+        return traverse<CULLING_BOTH, QUERY_CLOSEST>(r, hit);
     }
+}
 
-    if (closestDistance < 0)
+SceneObject *Mesh::findOccluder(Ray &r, CullingType culling)
+{
+    Hit hit;
+    bool found;
+    switch (culling)
     {
-        return false;
+    case CULLING_FRONT:
+        found = traverse<CULLING_FRONT, QUERY_ANY>(r, hit);
+        break;
+    case CULLING_BACK:
+        found = traverse<CULLING_BACK, QUERY_ANY>(r, hit);
+        break;
+    default:
+        found = traverse<CULLING_BOTH, QUERY_ANY>(r, hit);
+        break;
     }
+    return found ? hit.primitive : NULL;
+}
 
-    intersection = closestInter;
-    return true;
-}
\ No newline at end of file
+bool Mesh::getBounds(Bounds &bounds)
+{
+    bounds = box;
+    return !box.empty();
+}
@@ -6,19 +6,40 @@
 #include "../raymath/Color.hpp"
 #include "../raymath/Ray.hpp"
 #include "./Triangle.hpp"
-#include "../raymath/AABB.hpp" 
+#include "ObjCache.hpp"
+#include "Arena.hpp"
+#include "BVH.hpp"
 
 class Mesh : public SceneObject
 {
 private:
   std::vector<Triangle *> triangles;
-  AABB box;
+  // Over the transformed triangles, built by applyTransform()
+  BVH bvh;
+  Bounds box;
+
+  template <CullingType Culling, QueryType Query>
+  bool traverse(Ray &r, Hit &hit);
 public:
+  // Set by Scene::prepare(), before applyTransform()
+  BVHSettings bvhSettings;
+
   Mesh();
   ~Mesh();
 
-  void loadFromObj(std::string path);
+  /**
+   * Loads the triangles of an OBJ file (through the shared ObjCache).
+   * The triangles are created in one block of the arena (the one of the scene).
+   * The transform is applied later, by Scene::prepare().
+   */
+  void loadFromObj(std::string path, Arena &arena);
+  void setGeometry(MeshGeometry const &geometry, Arena &arena);
 
   virtual void applyTransform() override;
-  virtual bool intersects(Ray &r, Intersection &intersection, CullingType culling) override;
+  virtual bool intersects(Ray &r, Hit &hit, CullingType culling) override;
+  virtual SceneObject *findOccluder(Ray &r, CullingType culling) override;
+  virtual bool getBounds(Bounds &bounds) override;
+
+  int getTriangleCount() const { return triangles.size(); }
+  BVH const &getBVH() const { return bvh; }
 };
@@ -0,0 +1,90 @@
+#include <iostream>
+#include <filesystem>
+#include "ObjCache.hpp"
+#include "../objloader/OBJ_Loader.h"
+
+std::shared_ptr<const MeshGeometry> ObjCache::parse(std::string const &path)
+{
+    auto geometry = std::make_shared<MeshGeometry>();
+
+    objl::Loader loader;
+    if (loader.LoadFile(path))
+    {
+        for (int i = 0; i < loader.LoadedMeshes.size(); i++)
+        {
+            objl::Mesh &curMesh = loader.LoadedMeshes[i];
+            geometry->vertices.reserve(geometry->vertices.size() + curMesh.Indices.size());
+
+            for (int j = 0; j < curMesh.Indices.size(); ++j)
+            {
+                objl::Vector3 &p = curMesh.Vertices[curMesh.Indices[j]].Position;
+                geometry->vertices.push_back(Vector3(p.X, p.Y, p.Z));
+            }
+        }
+    }
+
+    return geometry;
+}
+
+std::shared_ptr<const MeshGeometry> ObjCache::load(std::string const &path)
+{
+    // The same file may be referenced with different relative paths
+    std::string key = std::filesystem::weakly_canonical(path).string();
+
+    std::error_code error;
+    std::filesystem::file_time_type modified = std::filesystem::last_write_time(path, error);
+
+    std::promise<std::shared_ptr<const MeshGeometry>> promise;
+    std::shared_future<std::shared_ptr<const MeshGeometry>> entry;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = entries.find(key);
+        if (it != entries.end() && it->second.modified == modified)
+        {
+            entry = it->second.geometry;
+        }
+        else
+        {
+            entries[key] = {modified, promise.get_future().share()};
+        }
+    }
+
+    if (entry.valid())
+    {
+        // Already parsed, or being parsed by another thread
+        return entry.get();
+    }
+
+    // First requester parses the file, outside of the lock
+    std::shared_ptr<const MeshGeometry> geometry;
+    try
+    {
+        geometry = parse(path);
+    }
+    catch (...)
+    {
+        // The waiting threads get the error too, and the next request parses the file again
+        promise.set_exception(std::current_exception());
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = entries.find(key);
+        if (it != entries.end() && it->second.modified == modified)
+        {
+            entries.erase(it);
+        }
+        throw;
+    }
+    promise.set_value(geometry);
+    return geometry;
+}
+
+void ObjCache::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    entries.clear();
+}
+
+ObjCache &ObjCache::shared()
+{
+    static ObjCache cache;
+    return cache;
+}
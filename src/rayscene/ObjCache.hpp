@@ -0,0 +1,46 @@
+#pragma once
+
+#include <filesystem>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "../raymath/Vector3.hpp"
+
+/**
+ * Geometry parsed from an OBJ file: 3 consecutive vertices per triangle (object space).
+ */
+struct MeshGeometry
+{
+  std::vector<Vector3> vertices;
+};
+
+/**
+ * Thread-safe cache of parsed OBJ files.
+ * Each path is parsed only once, even when several threads request it at the same time.
+ * An entry is parsed again when the modification time of its file changes.
+ * The entries are kept until clear() is called: a single render clears the cache once its scene is loaded,
+ * long-running modes (server, batch) keep it for the next scenes.
+ */
+class ObjCache
+{
+private:
+  struct Entry
+  {
+    std::filesystem::file_time_type modified;
+    std::shared_future<std::shared_ptr<const MeshGeometry>> geometry;
+  };
+
+  std::mutex mutex;
+  std::map<std::string, Entry> entries;
+
+  static std::shared_ptr<const MeshGeometry> parse(std::string const &path);
+
+public:
+  std::shared_ptr<const MeshGeometry> load(std::string const &path);
+  void clear();
+
+  static ObjCache &shared();
+};
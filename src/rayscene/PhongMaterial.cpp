@@ -1,5 +1,8 @@
 #include <iostream>
 #include <cmath>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
 #include "PhongMaterial.hpp"
 #include "Intersection.hpp"
 #include "Light.hpp"
@@ -8,6 +11,7 @@
 
 PhongMaterial::PhongMaterial()
 {
+  type = MATERIAL_PHONG;
 }
 
 PhongMaterial::~PhongMaterial()
@@ -19,38 +23,153 @@ Color PhongMaterial::getAmbient(Intersection *intersection)
   return Ambient;
 }
 
+bool PhongMaterial::equals(Material const &other) const
+{
+  if (!Material::equals(other))
+  {
+    return false;
+  }
+  PhongMaterial const &mat = static_cast<PhongMaterial const &>(other);
+  return Ambient.r == mat.Ambient.r && Ambient.g == mat.Ambient.g && Ambient.b == mat.Ambient.b &&
+         Diffuse.r == mat.Diffuse.r && Diffuse.g == mat.Diffuse.g && Diffuse.b == mat.Diffuse.b &&
+         Specular.r == mat.Specular.r && Specular.g == mat.Specular.g && Specular.b == mat.Specular.b &&
+         Shininess == mat.Shininess;
+}
+
+size_t PhongMaterial::hash() const
+{
+  size_t seed = Material::hash();
+  for (Color const *color : {&Ambient, &Diffuse, &Specular})
+  {
+    seed = combineHash(seed, color->r);
+    seed = combineHash(seed, color->g);
+    seed = combineHash(seed, color->b);
+  }
+  return combineHash(seed, Shininess);
+}
+
 Color PhongMaterial::render(Ray &r, Ray &camera, Intersection *intersection, Scene *scene)
+{
+  return shade(r, camera, intersection, scene, getAmbient(intersection));
+}
+
+Color PhongMaterial::shade(Ray &r, Ray &camera, Intersection *intersection, Scene *scene, Color ambient)
 {
 
-  Color color = getAmbient(intersection) * scene->globalAmbient;
+  Color color = ambient * scene->globalAmbient;
 
-  std::vector<Light *> lights = scene->getLights();
-  for (int i = 0; i < lights.size(); ++i)
+  LightBuffer const &lights = scene->getLightBuffer();
+  if (scene->lightSamples > 0 && scene->lightSamples < lights.size())
   {
-    Light *light = lights[i];
+    return color + sampleLights(intersection, scene, scene->lightSamples);
+  }
 
-    Vector3 lightDir = (light->GetPosition() - intersection->Position).normalize();
+  double dx[LightBuffer::BLOCK], dy[LightBuffer::BLOCK], dz[LightBuffer::BLOCK];
+  for (int begin = 0; begin < lights.size(); begin += LightBuffer::BLOCK)
+  {
+    int count = std::min(LightBuffer::BLOCK, lights.size() - begin);
+    lights.directions(intersection->Position, begin, count, dx, dy, dz);
 
-    Vector3 origin = intersection->Position + lightDir;
-    Ray lightRay(origin, lightDir);
-    Intersection shadowInter;
-    if (!scene->closestIntersection(lightRay, shadowInter, CULLING_BACK))
+    for (int i = 0; i < count; ++i)
     {
+      Vector3 lightDir(dx[i], dy[i], dz[i]);
 
       float dotProdLN = lightDir.dot(intersection->Normal);
-      if (dotProdLN > 0)
+      Vector3 R = (lightDir * -1).reflect(intersection->Normal);
+      float dotProdRV = R.dot(intersection->View);
+      if (dotProdLN <= 0 && dotProdRV <= 0)
       {
-        color = color + (light->Diffuse * Diffuse * dotProdLN);
+        // No contribution from this light, lit or not: no need for a shadow ray
+        continue;
       }
 
-      Vector3 R = (lightDir * -1).reflect(intersection->Normal);
-      float dotProdRV = R.dot(intersection->View);
-      if (dotProdRV > 0)
+      Vector3 origin = intersection->Position + lightDir;
+      Ray lightRay(origin, lightDir);
+      if (!scene->occluded(lightRay, begin + i))
       {
-        color = color + (light->Specular * Specular * pow(dotProdRV, Shininess));
+        if (dotProdLN > 0)
+        {
+          color = color + (lights.diffuse[begin + i] * Diffuse * dotProdLN);
+        }
+
+        if (dotProdRV > 0)
+        {
+          color = color + (lights.specular[begin + i] * Specular * pow(dotProdRV, Shininess));
+        }
       }
     }
   }
 
   return color;
-}
\ No newline at end of file
+}
+
+/**
+ * Random number in [0, 1[ from the shading point and the sample index.
+ * Stateless, so it is the same from one thread to another and from one run to another.
+ */
+static double shadingRandom(Vector3 const &point, int sample)
+{
+  double coords[3] = {point.x, point.y, point.z};
+  uint64_t h = sample;
+  for (double c : coords)
+  {
+    uint64_t bits;
+    std::memcpy(&bits, &c, sizeof(bits));
+    // splitmix64
+    h += bits + 0x9e3779b97f4a7c15ULL;
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+    h = h ^ (h >> 31);
+  }
+  return (h >> 11) * (1.0 / 9007199254740992.0);
+}
+
+Color PhongMaterial::sampleLights(Intersection *intersection, Scene *scene, int samples)
+{
+  LightBuffer const &lights = scene->getLightBuffer();
+  LightTree const &tree = scene->getLightTree();
+
+  // Sum of the weighted samples, not clamped until the end
+  float sum[3] = {0, 0, 0};
+  for (int s = 0; s < samples; ++s)
+  {
+    double pdf;
+    int l = tree.sample(intersection->Position, intersection->Normal, intersection->View, shadingRandom(intersection->Position, s), pdf);
+    if (l < 0)
+    {
+      // The walk ended in lights that cannot contribute: a null sample, the others still count
+      continue;
+    }
+
+    double dx, dy, dz;
+    lights.directions(intersection->Position, l, 1, &dx, &dy, &dz);
+    Vector3 lightDir(dx, dy, dz);
+
+    Vector3 origin = intersection->Position + lightDir;
+    Ray lightRay(origin, lightDir);
+    if (scene->occluded(lightRay, l))
+    {
+      continue;
+    }
+
+    Color light;
+    float dotProdLN = lightDir.dot(intersection->Normal);
+    if (dotProdLN > 0)
+    {
+      light = light + (lights.diffuse[l] * Diffuse * dotProdLN);
+    }
+    Vector3 R = (lightDir * -1).reflect(intersection->Normal);
+    float dotProdRV = R.dot(intersection->View);
+    if (dotProdRV > 0)
+    {
+      light = light + (lights.specular[l] * Specular * pow(dotProdRV, Shininess));
+    }
+
+    float weight = 1 / (pdf * samples);
+    sum[0] += light.r * weight;
+    sum[1] += light.g * weight;
+    sum[2] += light.b * weight;
+  }
+
+  return Color(sum[0], sum[1], sum[2]);
+}
@@ -23,4 +23,16 @@ public:
   ~PhongMaterial();
   virtual Color render(Ray &r, Ray &camera, Intersection *intersection, Scene *scene) override;
   virtual Color getAmbient(Intersection *intersection);
+  virtual bool equals(Material const &other) const override;
+  virtual size_t hash() const override;
+
+  /**
+   * Phong shading with the given ambient color (non virtual, used by Scene::shade)
+   */
+  Color shade(Ray &r, Ray &camera, Intersection *intersection, Scene *scene, Color ambient);
+
+  /**
+   * Estimate of the direct lighting from a few lights picked in the light tree of the scene.
+   */
+  Color sampleLights(Intersection *intersection, Scene *scene, int samples);
 };
@@ -11,7 +11,8 @@ Plane::~Plane()
 {
 }
 
-bool Plane::intersects(Ray &r, Intersection &intersection, CullingType culling)
+// Planes are one-sided whatever the culling: only hit from the side their normal faces
+bool Plane::intersects(Ray &r, Hit &hit, [[maybe_unused]] CullingType culling)
 {
 
   float denom = r.GetDirection().dot(normal);
@@ -25,10 +26,20 @@ bool Plane::intersects(Ray &r, Intersection &intersection, CullingType culling)
 
   float numer = (point - r.GetPosition()).dot(normal);
   float t = numer / denom;
+  if (t <= 0 || t >= hit.t)
+  {
+    return false;
+  }
 
-  intersection.Position = r.GetPosition() + (r.GetDirection() * t);
-  intersection.Normal = normal;
-  intersection.Mat = this->material;
+  hit.t = t;
+  hit.primitive = this;
 
   return true;
+}
+
+void Plane::fillIntersection(Ray &r, Hit const &hit, Intersection &intersection)
+{
+  intersection.Position = hit.position(r);
+  intersection.Normal = normal;
+  intersection.MatId = this->materialId;
 }
\ No newline at end of file
@@ -14,5 +14,6 @@ public:
   Plane(Vector3 p, Vector3 n);
   ~Plane();
 
-  virtual bool intersects(Ray &r, Intersection &intersection, CullingType culling) override;
+  virtual bool intersects(Ray &r, Hit &hit, CullingType culling) override;
+  virtual void fillIntersection(Ray &r, Hit const &hit, Intersection &intersection) override;
 };
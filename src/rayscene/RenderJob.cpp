@@ -0,0 +1,116 @@
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <stdexcept>
+#include "../json/json.hpp"
+#include "RenderJob.hpp"
+
+using json = nlohmann::json;
+
+RenderJob parseRenderJob(json data)
+{
+  if (!data.contains("scene"))
+  {
+    throw std::runtime_error("render job without a scene");
+  }
+
+  RenderJob job;
+  job.scenePath = data["scene"];
+  if (data.contains("output"))
+  {
+    job.outputPath = data["output"];
+  }
+  if (data.contains("width"))
+  {
+    job.width = data["width"];
+  }
+  if (data.contains("height"))
+  {
+    job.height = data["height"];
+  }
+  if (data.contains("reflections"))
+  {
+    job.reflections = data["reflections"];
+  }
+  if (data.contains("pngLevel"))
+  {
+    job.png.level = data["pngLevel"];
+  }
+  if (data.contains("pngFilter"))
+  {
+    job.png.filter = PngSettings::parseFilter(data["pngFilter"]);
+  }
+  if (data.contains("region"))
+  {
+    job.hasRegion = true;
+    job.region = ImageRegion::parse(data["region"]);
+  }
+  if (data.contains("inline"))
+  {
+    job.inlineOutput = data["inline"];
+  }
+  return job;
+}
+
+RenderJob RenderJob::fromJson(std::string const &text)
+{
+  return parseRenderJob(json::parse(text));
+}
+
+std::vector<RenderJob> RenderJob::loadManifest(std::string const &path)
+{
+  std::ifstream f(path);
+  if (!f.good())
+  {
+    throw std::runtime_error("Manifest file not found at path: " + path);
+  }
+
+  json data = json::parse(f);
+  if (!data.is_array())
+  {
+    throw std::runtime_error("a batch manifest must be an array of jobs");
+  }
+
+  std::filesystem::path parent = std::filesystem::path(path).parent_path();
+
+  std::vector<RenderJob> jobs;
+  for (auto &elem : data)
+  {
+    RenderJob job = parseRenderJob(elem);
+    if (std::filesystem::path(job.scenePath).is_relative())
+    {
+      job.scenePath = (parent / job.scenePath).string();
+    }
+    jobs.push_back(job);
+  }
+  return jobs;
+}
+
+Image *RenderJob::render(SceneCache &cache, bool *cached) const
+{
+  std::shared_ptr<const CachedScene> entry = cache.get(scenePath, cached);
+
+  Camera camera = entry->camera;
+  if (reflections >= 0)
+  {
+    camera.Reflections = reflections;
+  }
+
+  unsigned int frameWidth = width > 0 ? width : entry->width;
+  unsigned int frameHeight = height > 0 ? height : entry->height;
+
+  if (hasRegion)
+  {
+    if (region.x1 > frameWidth || region.y1 > frameHeight)
+    {
+      throw std::invalid_argument("region outside of the image");
+    }
+    Image *tile = new Image(region.width(), region.height());
+    camera.renderRegion(*tile, *entry->scene, frameWidth, frameHeight, region.x0, region.y0);
+    return tile;
+  }
+
+  Image *image = new Image(frameWidth, frameHeight);
+  camera.render(*image, *entry->scene);
+  return image;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "SceneCache.hpp"
+#include "../rayimage/Image.hpp"
+
+/**
+ * A render request: a scene file, an output file and optional overrides of the scene settings.
+ */
+struct RenderJob
+{
+  std::string scenePath;
+  std::string outputPath = "image.png";
+
+  // Overrides, negative values keep the settings of the scene file
+  int width = -1;
+  int height = -1;
+  int reflections = -1;
+
+  PngSettings png;
+
+  // Send the pixels back on the connection (raw floats, see Image::toRaw) instead of writing the output file
+  bool inlineOutput = false;
+
+  // Only render this tile of the frame (the output image has the size of the tile)
+  bool hasRegion = false;
+  ImageRegion region;
+
+  /**
+   * Parses a job from a JSON object:
+   * {"scene": "...", "output": "...", "width": 800, "height": 600, "reflections": 2,
+   *  "pngLevel": 6, "pngFilter": "minsum", "region": "x0,y0,x1,y1", "inline": false}
+   */
+  static RenderJob fromJson(std::string const &text);
+
+  /**
+   * Loads a batch manifest: a JSON array of jobs.
+   * Relative scene paths are resolved from the directory of the manifest.
+   */
+  static std::vector<RenderJob> loadManifest(std::string const &path);
+
+  /**
+   * Renders the job using (and filling) the scene cache. The caller owns the returned image.
+   */
+  Image *render(SceneCache &cache, bool *cached = nullptr) const;
+};
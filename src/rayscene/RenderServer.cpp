@@ -0,0 +1,189 @@
+#include <iostream>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "../json/json.hpp"
+#include "RenderServer.hpp"
+#include "RenderJob.hpp"
+
+using json = nlohmann::json;
+
+RenderServer::RenderServer(std::string path) : socketPath(path)
+{
+}
+
+RenderServer::~RenderServer()
+{
+}
+
+int RenderServer::run()
+{
+  sockaddr_un address;
+  std::memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (socketPath.size() >= sizeof(address.sun_path))
+  {
+    std::cerr << "[ERROR] Socket path too long: " << socketPath << std::endl;
+    return 1;
+  }
+  std::strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+
+  int server = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (server < 0)
+  {
+    std::cerr << "[ERROR] Could not create socket: " << std::strerror(errno) << std::endl;
+    return 1;
+  }
+
+  // A previous server may have left its socket file behind
+  unlink(socketPath.c_str());
+  if (bind(server, (sockaddr *)&address, sizeof(address)) < 0 || listen(server, 16) < 0)
+  {
+    std::cerr << "[ERROR] Could not listen on " << socketPath << ": " << std::strerror(errno) << std::endl;
+    close(server);
+    return 1;
+  }
+
+  // A client closing its connection early must not kill the server
+  std::signal(SIGPIPE, SIG_IGN);
+
+  std::cout << "Listening on " << socketPath << std::endl;
+
+  running = true;
+  while (running)
+  {
+    int client = accept(server, NULL, NULL);
+    if (client < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+      std::cerr << "[ERROR] accept failed: " << std::strerror(errno) << std::endl;
+      break;
+    }
+
+    serveClient(client);
+    close(client);
+  }
+
+  close(server);
+  unlink(socketPath.c_str());
+  return 0;
+}
+
+void RenderServer::serveClient(int client)
+{
+  std::string pending;
+  char buffer[4096];
+
+  while (running)
+  {
+    ssize_t count = read(client, buffer, sizeof(buffer));
+    if (count < 0 && errno == EINTR)
+    {
+      continue;
+    }
+    if (count <= 0)
+    {
+      return;
+    }
+    pending.append(buffer, count);
+
+    // One request per line
+    size_t end;
+    while (running && (end = pending.find('\n')) != std::string::npos)
+    {
+      std::string line = pending.substr(0, end);
+      pending.erase(0, end + 1);
+      if (line.find_first_not_of(" \t\r") == std::string::npos)
+      {
+        continue;
+      }
+
+      std::string payload;
+      std::string response = handleRequest(line, payload) + "\n" + payload;
+      size_t written = 0;
+      while (written < response.size())
+      {
+        ssize_t n = write(client, response.data() + written, response.size() - written);
+        if (n < 0 && errno == EINTR)
+        {
+          continue;
+        }
+        if (n <= 0)
+        {
+          return;
+        }
+        written += n;
+      }
+    }
+  }
+}
+
+std::string RenderServer::handleRequest(std::string const &line, std::string &payload)
+{
+  json response;
+  try
+  {
+    json request = json::parse(line);
+    if (request.contains("command"))
+    {
+      std::string command = request["command"];
+      if (command == "shutdown")
+      {
+        running = false;
+        response["status"] = "ok";
+        return response.dump();
+      }
+      throw std::runtime_error("unknown command: " + command);
+    }
+
+    RenderJob job = RenderJob::fromJson(line);
+
+    bool cached = false;
+    auto begin = std::chrono::high_resolution_clock::now();
+    Image *image = job.render(cache, &cached);
+    auto end = std::chrono::high_resolution_clock::now();
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin);
+
+    std::string output = job.outputPath;
+    if (job.inlineOutput)
+    {
+      payload = image->toRaw();
+      output = "(inline)";
+    }
+    else
+    {
+      image->writeFile(job.outputPath, job.png);
+    }
+    delete image;
+
+    std::printf("Rendered %s -> %s in %.3f seconds%s.\n", job.scenePath.c_str(), output.c_str(),
+                elapsed.count() * 1e-9, cached ? " (cached scene)" : "");
+    std::fflush(stdout);
+
+    response["status"] = "ok";
+    if (job.inlineOutput)
+    {
+      response["bytes"] = payload.size();
+    }
+    else
+    {
+      response["output"] = job.outputPath;
+    }
+    response["cached"] = cached;
+    response["time"] = elapsed.count() * 1e-9;
+  }
+  catch (std::exception const &e)
+  {
+    std::cerr << "[ERROR] " << e.what() << std::endl;
+    response = json();
+    response["status"] = "error";
+    response["message"] = e.what();
+  }
+  return response.dump();
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <string>
+#include "SceneCache.hpp"
+
+/**
+ * Long-running render process listening on a local Unix socket.
+ *
+ * Each line received is a JSON request, answered by one JSON line:
+ * - a render job (see RenderJob::fromJson) -> {"status": "ok", "output": ..., "cached": ..., "time": ...}
+ * - {"command": "shutdown"} stops the server.
+ * Loaded scenes stay in the cache between jobs.
+ */
+class RenderServer
+{
+private:
+  std::string socketPath;
+  SceneCache cache;
+  bool running = false;
+
+  void serveClient(int client);
+  // payload: bytes sent right after the answer line (pixels of an inline job)
+  std::string handleRequest(std::string const &line, std::string &payload);
+
+public:
+  RenderServer(std::string path);
+  ~RenderServer();
+
+  /**
+   * Accepts connections until a shutdown command is received. Returns the process exit code.
+   */
+  int run();
+};
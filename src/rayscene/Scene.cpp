@@ -1,75 +1,248 @@
 #include <iostream>
 #include "Scene.hpp"
 #include "Intersection.hpp"
+#include "ThreadPool.hpp"
+#include "PhongMaterial.hpp"
+#include "CheckerMaterial.hpp"
+#include <stdexcept>
+#include <atomic>
 #include <cmath> // Ajouté pour sqrt si nécessaire
 
-Scene::Scene() {}
+Scene::Scene()
+{
+  static std::atomic<unsigned long long> nextId(0);
+  id = nextId++;
+}
 
 Scene::~Scene()
 {
-  for (int i = 0; i < objects.size(); ++i) delete objects[i];
-  for (int i = 0; i < lights.size(); ++i) delete lights[i];
+  // Objects, lights and materials are released with the arena
 }
 
 void Scene::add(SceneObject *object) { objects.push_back(object); }
 void Scene::addLight(Light *light) { lights.push_back(light); }
 
-void Scene::prepare()
+MaterialId Scene::addMaterial(Material *material)
 {
-  for (int i = 0; i < objects.size(); ++i) objects[i]->applyTransform();
+  size_t hash = material->hash();
+  auto range = materialsByHash.equal_range(hash);
+  for (auto it = range.first; it != range.second; ++it)
+  {
+    if (materials[it->second]->equals(*material))
+    {
+      return it->second;
+    }
+  }
+  MaterialId id = materials.size();
+  materials.push_back(material);
+  materialsByHash.emplace(hash, id);
+  return id;
 }
 
-std::vector<Light *> Scene::getLights() { return lights; }
+Material *Scene::getMaterial(MaterialId id) { return id == NO_MATERIAL ? NULL : materials[id]; }
 
-bool Scene::closestIntersection(Ray &r, Intersection &closest, CullingType culling)
+void Scene::prepare()
 {
-  Intersection intersection;
-  double closestDistSq = -1; // On stocke la distance au carré
-  Intersection closestInter;
+  if (prepared)
+  {
+    return;
+  }
 
+  // Transforms (and mesh BVH) are independent from one object to another
+  ThreadPool &pool = ThreadPool::shared();
+  std::vector<std::future<void>> tasks;
   for (int i = 0; i < objects.size(); ++i)
   {
-    if (objects[i]->intersects(r, intersection, culling))
+    SceneObject *object = objects[i];
+    if (Mesh *mesh = dynamic_cast<Mesh *>(object))
     {
-      // OPTIMISATION : lengthSquared() au lieu de length()
-      double distSq = (intersection.Position - r.GetPosition()).lengthSquared();
+      mesh->bvhSettings = bvhSettings;
+    }
+    tasks.push_back(pool.submit([object]()
+                                { object->applyTransform(); }));
+  }
+  for (auto &task : tasks)
+  {
+    pool.wait(task);
+    task.get();
+  }
+  buckets.build(objects);
+  objectBounds.assign(objects.size(), Bounds());
+  for (int i = 0; i < objects.size(); ++i)
+  {
+    objects[i]->getBounds(objectBounds[i]);
+  }
+  lightBuffer.build(lights);
+  lightTree.build(lightBuffer);
+  prepared = true;
+}
 
-      if (closestDistSq < 0 || distSq < closestDistSq)
-      {
-        closestDistSq = distSq;
-        closestInter = intersection;
-        // On calcule la vraie distance seulement si on garde cet objet
-        closestInter.Distance = std::sqrt(distSq); 
-      }
+std::vector<SceneObject *> const &Scene::getObjects() const { return objects; }
+
+std::vector<Light *> const &Scene::getLights() const { return lights; }
+
+LightBuffer const &Scene::getLightBuffer() const { return lightBuffer; }
+
+LightTree const &Scene::getLightTree() const { return lightTree; }
+
+bool Scene::closestIntersection(Ray &r, Intersection &closest, CullingType culling, SceneBuckets *objects)
+{
+  // The ray ends at the closest hit so far: farther objects are rejected early
+  Hit closestHit;
+  bool found = (objects != NULL ? objects : &buckets)->closestHit(r, closestHit, culling);
+
+  closest = Intersection();
+  if (!found)
+  {
+    return false;
+  }
+
+  // Shading data only for the closest hit
+  closestHit.primitive->fillIntersection(r, closestHit, closest);
+  closest.Distance = (closest.Position - r.GetPosition()).length();
+  return true;
+}
+
+/**
+ * Whether the box is entirely on the outer side of one of the planes (through origin, normals inwards).
+ * A box touching a plane, up to rounding, is kept.
+ */
+static bool outsideFrustum(Bounds const &box, Vector3 const &origin, Vector3 const normals[4])
+{
+  Vector3 center((box.min[0] + box.max[0]) / 2, (box.min[1] + box.max[1]) / 2, (box.min[2] + box.max[2]) / 2);
+  Vector3 half((box.max[0] - box.min[0]) / 2, (box.max[1] - box.min[1]) / 2, (box.max[2] - box.min[2]) / 2);
+  Vector3 offset = center - origin;
+  double scale = offset.length() + half.length();
+
+  for (int i = 0; i < 4; ++i)
+  {
+    Vector3 const &n = normals[i];
+    // Signed distance of the corner of the box the farthest inside, times |n|
+    double inside = n.dot(offset) + std::abs(n.x) * half.x + std::abs(n.y) * half.y + std::abs(n.z) * half.z;
+    if (inside < -1e-6 * n.length() * scale)
+    {
+      return true;
     }
   }
-  closest = closestInter;
-  return (closestDistSq > -1);
+  return false;
 }
 
-Color Scene::raycast(Ray &r, Ray &camera, int castCount, int maxCastCount)
+std::vector<Bounds> const &Scene::getObjectBounds() const { return objectBounds; }
+
+int Scene::cullObjects(Vector3 const &origin, Vector3 const corners[4], std::vector<int> const &candidates,
+                       SceneBuckets &visible)
+{
+  Vector3 axis = corners[0] + corners[1] + corners[2] + corners[3];
+  Vector3 normals[4];
+  for (int i = 0; i < 4; ++i)
+  {
+    normals[i] = corners[i].cross(corners[(i + 1) % 4]);
+    if (normals[i].dot(axis) < 0)
+    {
+      normals[i] = normals[i] * -1;
+    }
+  }
+
+  std::vector<SceneObject *> kept;
+  for (int i : candidates)
+  {
+    if (objectBounds[i].empty() || !outsideFrustum(objectBounds[i], origin, normals))
+    {
+      kept.push_back(objects[i]);
+    }
+  }
+  visible.build(kept);
+  return kept.size();
+}
+
+Color Scene::raycast(Ray &r, Ray &camera, int castCount, int maxCastCount, SceneBuckets *objects)
 {
   Color pixel;
   Intersection intersection;
 
-  if (closestIntersection(r, intersection, CULLING_FRONT))
+  if (closestIntersection(r, intersection, CULLING_FRONT, objects))
   {
     intersection.View = (camera.GetPosition() - intersection.Position).normalize();
 
-    if (intersection.Mat != NULL)
+    if (intersection.MatId != NO_MATERIAL)
     {
-      pixel = pixel + (intersection.Mat)->render(r, camera, &intersection, this);
+      Material *mat = materials[intersection.MatId];
+      pixel = pixel + shade(r, camera, intersection);
 
       // OPTIMISATION #3 : Remplacement de '&' par '&&' (Logique vs Binaire)
-      if (castCount < maxCastCount && intersection.Mat->cReflection > 0)
+      if (castCount < maxCastCount && mat->cReflection > 0)
       {
         Vector3 reflectDir = r.GetDirection().reflect(intersection.Normal);
         Vector3 origin = intersection.Position + (reflectDir * COMPARE_ERROR_CONSTANT);
         Ray reflectRay(origin, reflectDir);
 
-        pixel = pixel + raycast(reflectRay, camera, castCount + 1, maxCastCount) * intersection.Mat->cReflection;
+        pixel = pixel + raycast(reflectRay, camera, castCount + 1, maxCastCount) * mat->cReflection;
       }
     }
   }
   return pixel;
-}
\ No newline at end of file
+}
+
+/**
+ * Last occluder of each light, for the scene being rendered by this thread
+ */
+struct ShadowCache
+{
+  unsigned long long sceneId = ~0ULL;
+  std::vector<SceneObject *> occluders;
+};
+
+static thread_local ShadowCache shadowCacheOfThread;
+
+bool Scene::occluded(Ray &r, int light)
+{
+  if (!shadowCache)
+  {
+    return buckets.findOccluder(r, CULLING_BACK) != NULL;
+  }
+
+  ShadowCache &cache = shadowCacheOfThread;
+  if (cache.sceneId != id || cache.occluders.size() != lights.size())
+  {
+    cache.sceneId = id;
+    cache.occluders.assign(lights.size(), NULL);
+  }
+
+  // Any hit blocks the light, so a hit on the cached primitive is enough
+  Hit hit;
+  SceneObject *&last = cache.occluders[light];
+  if (last != NULL && last->intersects(r, hit, CULLING_BACK))
+  {
+    return true;
+  }
+
+  SceneObject *occluder = buckets.findOccluder(r, CULLING_BACK);
+  if (occluder != NULL)
+  {
+    last = occluder;
+    return true;
+  }
+  return false;
+}
+
+Color Scene::shade(Ray &r, Ray &camera, Intersection &intersection)
+{
+  Material *mat = materials[intersection.MatId];
+
+  // Qualified calls: no virtual dispatch for the known material types
+  switch (mat->type)
+  {
+  case MATERIAL_PHONG:
+  {
+    PhongMaterial *phong = static_cast<PhongMaterial *>(mat);
+    return phong->shade(r, camera, &intersection, this, phong->PhongMaterial::getAmbient(&intersection));
+  }
+  case MATERIAL_CHECKER:
+  {
+    CheckerMaterial *checker = static_cast<CheckerMaterial *>(mat);
+    return checker->shade(r, camera, &intersection, this, checker->CheckerMaterial::getAmbient(&intersection));
+  }
+  default:
+    return Color();
+  }
+}
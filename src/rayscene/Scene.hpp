@@ -1,9 +1,13 @@
 #pragma once
 
 #include <vector>
+#include <unordered_map>
 #include "../raymath/Ray.hpp"
 #include "../raymath/Color.hpp"
 #include "Light.hpp"
+#include "LightTree.hpp"
+#include "Arena.hpp"
+#include "SceneBuckets.hpp"
 #include "SceneObject.hpp"
 
 class Scene
@@ -11,19 +15,117 @@ class Scene
 private:
   std::vector<SceneObject *> objects;
   std::vector<Light *> lights;
+  std::vector<Material *> materials;
+  // Ids of the materials by hash, to merge equal materials
+  std::unordered_multimap<size_t, MaterialId> materialsByHash;
+  LightBuffer lightBuffer;
+  LightTree lightTree;
+  // Objects sorted by type, for the intersection loops
+  SceneBuckets buckets;
+  // Box of each object (once prepared), for the culling; empty for unbounded objects
+  std::vector<Bounds> objectBounds;
+  bool prepared = false;
+  // Unique for the process, so per-thread caches can tell scenes apart
+  unsigned long long id;
 
 public:
   Scene();
   ~Scene();
 
+  /**
+   * Memory of everything the scene owns: objects, lights and materials must be created in it.
+   * It is released at once with the scene.
+   */
+  Arena arena;
+
   Color globalAmbient;
 
+  /**
+   * Number of lights sampled per shading point (0 = all the lights, exact).
+   * When the scene has more lights than that, they are picked from the light tree
+   * proportionally to their estimated contribution.
+   */
+  int lightSamples = 0;
+
+  /**
+   * Remember, per thread and per light, the last primitive that blocked a shadow ray,
+   * and test it first for the next one (neighbouring points are usually blocked by the same primitive).
+   */
+  bool shadowCache = true;
+
+  /**
+   * Each tile of the image first selects the objects its primary rays may hit (frustum culling),
+   * and its primary rays only test those.
+   */
+  bool tileCulling = true;
+
+  /**
+   * How the BVH of the meshes are built (LBVH: much faster to build, for previews of large meshes;
+   * SBVH: faster to traverse with long thin triangles, for final renders).
+   */
+  BVHSettings bvhSettings;
+
+  /**
+   * Files the scene was loaded from (scene JSON first, then OBJ files).
+   * Used to invalidate cached scenes when one of them changes.
+   */
+  std::vector<std::string> sourceFiles;
+
   void add(SceneObject *object);
   void addLight(Light *light);
-  std::vector<Light *> getLights();
 
+  /**
+   * Adds a material (created in the arena) to the table of the scene and returns its id.
+   * For a material equal to one already in the table, the existing id is returned.
+   */
+  MaterialId addMaterial(Material *material);
+  Material *getMaterial(MaterialId id);
+  std::vector<SceneObject *> const &getObjects() const;
+  std::vector<Light *> const &getLights() const;
+
+  /**
+   * Packed copy of the lights, valid once the scene is prepared.
+   */
+  LightBuffer const &getLightBuffer() const;
+  LightTree const &getLightTree() const;
+
+  /**
+   * Applies the transforms and builds the acceleration structures.
+   * Only done once: a prepared scene can be rendered several times.
+   */
   void prepare();
-  Color raycast(Ray &r, Ray &camera, int castCount, int maxCastCount);
+  /**
+   * Color seen along the ray. The first intersection is looked for in objects when given
+   * (the objects of a tile, see cullObjects), the reflections in the whole scene.
+   */
+  Color raycast(Ray &r, Ray &camera, int castCount, int maxCastCount, SceneBuckets *objects = NULL);
+
+  /**
+   * Shades an intersection, dispatching on the type of its material
+   */
+  Color shade(Ray &r, Ray &camera, Intersection &intersection);
+
+  /**
+   * Closest object hit by the ray. The scene must be prepared.
+   */
+  bool closestIntersection(Ray &r, Intersection &closest, CullingType culling, SceneBuckets *objects = NULL);
+
+  /**
+   * Box of each object, empty for the unbounded ones. The scene must be prepared.
+   */
+  std::vector<Bounds> const &getObjectBounds() const;
+
+  /**
+   * Objects among the candidates (indices in increasing order) that rays starting at origin,
+   * with a direction inside the pyramid of the 4 corner directions (in order around the pyramid),
+   * may hit: the ones whose box is not outside it, and all the unbounded ones.
+   * Returns their number. The scene must be prepared.
+   */
+  int cullObjects(Vector3 const &origin, Vector3 const corners[4], std::vector<int> const &candidates,
+                  SceneBuckets &visible);
 
-  bool closestIntersection(Ray &r, Intersection &closest, CullingType culling);
+  /**
+   * Whether anything blocks the shadow ray towards the light with the given index.
+   */
+  bool occluded(Ray &r, int light);
 };
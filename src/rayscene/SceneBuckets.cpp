@@ -0,0 +1,319 @@
+#include <cmath>
+#include <algorithm>
+#include "SceneBuckets.hpp"
+
+void SphereBucket::add(Sphere *sphere)
+{
+  Vector3 const &center = sphere->getCenter();
+  x.push_back(center.x);
+  y.push_back(center.y);
+  z.push_back(center.z);
+  radius.push_back(sphere->getRadius());
+  radiusSquared.push_back(sphere->getRadius() * sphere->getRadius());
+  spheres.push_back(sphere);
+}
+
+/**
+ * Relative margin of the filter, far above the rounding errors of both forms of the test
+ */
+static const double FILTER_SLACK = 1e-9;
+
+int SphereBucket::candidates(Vector3 const &o, Vector3 const &d, double tMax, int begin, int count, int *out,
+                             double *low, double *high) const
+{
+  double dd = d.dot(d);
+  double length = std::sqrt(dd);
+  int n = 0;
+  for (int i = begin; i < begin + count; ++i)
+  {
+    double ocx = x[i] - o.x;
+    double ocy = y[i] - o.y;
+    double ocz = z[i] - o.z;
+    // Distance along the ray to the projection of the center, and squared distance from the ray
+    double k = ocx * d.x + ocy * d.y + ocz * d.z;
+    double ocSquared = ocx * ocx + ocy * ocy + ocz * ocz;
+    double perpendicular = ocSquared - k * k / dd;
+    double slack = FILTER_SLACK * (ocSquared + radiusSquared[i]);
+    bool keep = k > 0 && perpendicular <= radiusSquared[i] + slack && k - radius[i] < tMax + slack;
+    if (keep)
+    {
+      // Nearest root, give or take the rounding errors of both forms (|sqrt(a) - sqrt(b)| <= sqrt(|a - b|))
+      double t = k * length - std::sqrt(std::max(0.0, radiusSquared[i] - perpendicular));
+      double error = std::sqrt(slack) + FILTER_SLACK * (k + radius[i]);
+      out[n] = i - begin;
+      low[n] = t - error;
+      high[n] = perpendicular <= radiusSquared[i] - slack ? t + error : INFINITY;
+      n++;
+    }
+  }
+  return n;
+}
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+
+/**
+ * Same filter as SphereBucket::candidates, 4 spheres at a time (count must be a multiple of 4).
+ * The remaining spheres are left to the portable version, outside of this function:
+ * mixing AVX and SSE code in the same function slows the SSE part down a lot.
+ */
+__attribute__((target("avx2"))) static int candidatesAvx2(SphereBucket const &bucket, Vector3 const &o, Vector3 const &d,
+                                                          double tMax, int begin, int count, int *out, double *low,
+                                                          double *high)
+{
+  __m256d ox = _mm256_set1_pd(o.x), oy = _mm256_set1_pd(o.y), oz = _mm256_set1_pd(o.z);
+  __m256d dx = _mm256_set1_pd(d.x), dy = _mm256_set1_pd(d.y), dz = _mm256_set1_pd(d.z);
+  __m256d dd = _mm256_set1_pd(d.dot(d));
+  __m256d length = _mm256_sqrt_pd(dd);
+  __m256d zero = _mm256_setzero_pd();
+  __m256d relative = _mm256_set1_pd(FILTER_SLACK);
+  __m256d limit = _mm256_set1_pd(tMax);
+  __m256d infinity = _mm256_set1_pd(INFINITY);
+
+  int n = 0;
+  int i = begin;
+  for (; i + 4 <= begin + count; i += 4)
+  {
+    __m256d ocx = _mm256_sub_pd(_mm256_loadu_pd(&bucket.x[i]), ox);
+    __m256d ocy = _mm256_sub_pd(_mm256_loadu_pd(&bucket.y[i]), oy);
+    __m256d ocz = _mm256_sub_pd(_mm256_loadu_pd(&bucket.z[i]), oz);
+    __m256d r = _mm256_loadu_pd(&bucket.radius[i]);
+    __m256d r2 = _mm256_loadu_pd(&bucket.radiusSquared[i]);
+
+    __m256d k = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(ocx, dx), _mm256_mul_pd(ocy, dy)), _mm256_mul_pd(ocz, dz));
+    __m256d ocSquared = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(ocx, ocx), _mm256_mul_pd(ocy, ocy)), _mm256_mul_pd(ocz, ocz));
+    __m256d perpendicular = _mm256_sub_pd(ocSquared, _mm256_div_pd(_mm256_mul_pd(k, k), dd));
+    __m256d slack = _mm256_mul_pd(relative, _mm256_add_pd(ocSquared, r2));
+
+    __m256d keep = _mm256_cmp_pd(k, zero, _CMP_GT_OQ);
+    keep = _mm256_and_pd(keep, _mm256_cmp_pd(perpendicular, _mm256_add_pd(r2, slack), _CMP_LE_OQ));
+    keep = _mm256_and_pd(keep, _mm256_cmp_pd(_mm256_sub_pd(k, r), _mm256_add_pd(limit, slack), _CMP_LT_OQ));
+
+    int mask = _mm256_movemask_pd(keep);
+    if (mask == 0)
+    {
+      continue;
+    }
+
+    // Bounds of the nearest roots, as in SphereBucket::candidates
+    __m256d t = _mm256_sub_pd(_mm256_mul_pd(k, length), _mm256_sqrt_pd(_mm256_max_pd(zero, _mm256_sub_pd(r2, perpendicular))));
+    __m256d error = _mm256_add_pd(_mm256_sqrt_pd(slack), _mm256_mul_pd(relative, _mm256_add_pd(k, r)));
+    __m256d sure = _mm256_cmp_pd(perpendicular, _mm256_sub_pd(r2, slack), _CMP_LE_OQ);
+    double lanesLow[4], lanesHigh[4];
+    _mm256_storeu_pd(lanesLow, _mm256_sub_pd(t, error));
+    _mm256_storeu_pd(lanesHigh, _mm256_blendv_pd(infinity, _mm256_add_pd(t, error), sure));
+
+    while (mask != 0)
+    {
+      int lane = __builtin_ctz(mask);
+      out[n] = i - begin + lane;
+      low[n] = lanesLow[lane];
+      high[n] = lanesHigh[lane];
+      n++;
+      mask &= mask - 1;
+    }
+  }
+
+  return n;
+}
+
+static bool hasAvx2()
+{
+  static bool avx2 = __builtin_cpu_supports("avx2");
+  return avx2;
+}
+#endif
+
+template <QueryType Query>
+bool SphereBucket::intersects(Ray &r, Hit &hit) const
+{
+  Vector3 o = r.GetPosition();
+  Vector3 d = r.GetDirection();
+  int candidate[BLOCK];
+  double low[BLOCK];
+  double high[BLOCK];
+  bool found = false;
+
+  for (int begin = 0; begin < size(); begin += BLOCK)
+  {
+    int count = std::min(BLOCK, size() - begin);
+    int n = 0;
+    int vectorized = 0;
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+    if (count >= 4 && hasAvx2())
+    {
+      vectorized = count - count % 4;
+      n = candidatesAvx2(*this, o, d, hit.t, begin, vectorized, candidate, low, high);
+    }
+#endif
+    int rest = candidates(o, d, hit.t, begin + vectorized, count - vectorized, candidate + n, low + n, high + n);
+    for (int c = n; c < n + rest; ++c)
+    {
+      candidate[c] += vectorized;
+    }
+    n += rest;
+
+    // Closest hit: a sphere whose root is surely beyond the root of another one cannot win
+    double nearest = hit.t;
+    if (Query == QUERY_CLOSEST)
+    {
+      for (int c = 0; c < n; ++c)
+      {
+        nearest = std::min(nearest, high[c]);
+      }
+    }
+
+    // Exact test in the original order: the first closest sphere wins, as before
+    for (int c = 0; c < n; ++c)
+    {
+      if (Query == QUERY_CLOSEST && low[c] > nearest)
+      {
+        continue;
+      }
+      Sphere *sphere = spheres[begin + candidate[c]];
+      if (sphere->Sphere::intersects(r, hit, CULLING_BOTH))
+      {
+        if (Query == QUERY_ANY)
+        {
+          return true;
+        }
+        found = true;
+      }
+    }
+  }
+  return found;
+}
+
+void SceneBuckets::build(std::vector<SceneObject *> const &objects)
+{
+  spheres = SphereBucket();
+  planes.clear();
+  triangles.clear();
+  meshes.clear();
+  others.clear();
+
+  for (SceneObject *object : objects)
+  {
+    if (Sphere *sphere = dynamic_cast<Sphere *>(object))
+    {
+      spheres.add(sphere);
+    }
+    else if (Plane *plane = dynamic_cast<Plane *>(object))
+    {
+      planes.push_back(plane);
+    }
+    else if (Triangle *triangle = dynamic_cast<Triangle *>(object))
+    {
+      triangles.push_back(triangle);
+    }
+    else if (Mesh *mesh = dynamic_cast<Mesh *>(object))
+    {
+      meshes.push_back(mesh);
+    }
+    else
+    {
+      others.push_back(object);
+    }
+  }
+}
+
+template <CullingType Culling, QueryType Query>
+bool SceneBuckets::traverse(Ray &r, Hit &hit)
+{
+  bool found = spheres.intersects<Query>(r, hit);
+  if (Query == QUERY_ANY && found)
+  {
+    return true;
+  }
+
+  for (Plane *plane : planes)
+  {
+    if (plane->Plane::intersects(r, hit, Culling))
+    {
+      if (Query == QUERY_ANY)
+      {
+        return true;
+      }
+      found = true;
+    }
+  }
+
+  for (Triangle *triangle : triangles)
+  {
+    if (triangle->hitTest<Culling, Query>(r, hit))
+    {
+      if (Query == QUERY_ANY)
+      {
+        return true;
+      }
+      found = true;
+    }
+  }
+
+  for (Mesh *mesh : meshes)
+  {
+    if (Query == QUERY_ANY)
+    {
+      SceneObject *occluder = mesh->Mesh::findOccluder(r, Culling);
+      if (occluder != NULL)
+      {
+        hit.primitive = occluder;
+        return true;
+      }
+    }
+    else if (mesh->Mesh::intersects(r, hit, Culling))
+    {
+      found = true;
+    }
+  }
+
+  for (SceneObject *object : others)
+  {
+    if (Query == QUERY_ANY)
+    {
+      SceneObject *occluder = object->findOccluder(r, Culling);
+      if (occluder != NULL)
+      {
+        hit.primitive = occluder;
+        return true;
+      }
+    }
+    else if (object->intersects(r, hit, Culling))
+    {
+      found = true;
+    }
+  }
+  return found;
+}
+
+bool SceneBuckets::closestHit(Ray &r, Hit &hit, CullingType culling)
+{
+  switch (culling)
+  {
+  case CULLING_FRONT:
+    return traverse<CULLING_FRONT, QUERY_CLOSEST>(r, hit);
+  case CULLING_BACK:
+    return traverse<CULLING_BACK, QUERY_CLOSEST>(r, hit);
+  default:
+    return traverse<CULLING_BOTH, QUERY_CLOSEST>(r, hit);
+  }
+}
+
+SceneObject *SceneBuckets::findOccluder(Ray &r, CullingType culling)
+{
+  Hit hit;
+  bool found;
+  switch (culling)
+  {
+  case CULLING_FRONT:
+    found = traverse<CULLING_FRONT, QUERY_ANY>(r, hit);
+    break;
+  case CULLING_BACK:
+    found = traverse<CULLING_BACK, QUERY_ANY>(r, hit);
+    break;
+  default:
+    found = traverse<CULLING_BOTH, QUERY_ANY>(r, hit);
+    break;
+  }
+  return found ? hit.primitive : NULL;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <vector>
+#include "SceneObject.hpp"
+#include "Sphere.hpp"
+#include "Plane.hpp"
+#include "Triangle.hpp"
+#include "Mesh.hpp"
+
+/**
+ * Spheres of a scene as arrays of centers and radii.
+ * A block of spheres is first filtered with the discriminant form of the ray-sphere test
+ * (4 spheres at a time with AVX2, when the CPU has it), which also bounds the nearest root of each candidate.
+ * Only the candidate with the nearest root (and the ones too close to it to tell) goes through
+ * the exact Sphere::intersects, which gives the same distance as the spheres outside of a bucket.
+ */
+struct SphereBucket
+{
+  static constexpr int BLOCK = 64;
+
+  std::vector<double> x;
+  std::vector<double> y;
+  std::vector<double> z;
+  std::vector<double> radius;
+  std::vector<double> radiusSquared;
+  std::vector<Sphere *> spheres;
+
+  /**
+   * Indices (in order, relative to begin) of the spheres of [begin, begin + count[ that may be hit
+   * before tMax. Conservative: a sphere left out is never accepted by Sphere::intersects.
+   * The distance Sphere::intersects would return for out[c] is at least low[c], and at most high[c]
+   * (infinite when the sphere may be missed).
+   */
+  int candidates(Vector3 const &o, Vector3 const &d, double tMax, int begin, int count, int *out, double *low,
+                 double *high) const;
+
+  void add(Sphere *sphere);
+  int size() const { return (int)spheres.size(); }
+
+  /**
+   * Same results as Sphere::intersects on each sphere, in order.
+   */
+  template <QueryType Query>
+  bool intersects(Ray &r, Hit &hit) const;
+};
+
+/**
+ * Objects of a prepared scene sorted by type, each type in its own array,
+ * so the intersection loops make direct (non-virtual) calls.
+ */
+class SceneBuckets
+{
+private:
+  SphereBucket spheres;
+  std::vector<Plane *> planes;
+  std::vector<Triangle *> triangles;
+  std::vector<Mesh *> meshes;
+  // Types without a bucket, still intersected through the virtual interface
+  std::vector<SceneObject *> others;
+
+  template <CullingType Culling, QueryType Query>
+  bool traverse(Ray &r, Hit &hit);
+
+public:
+  void build(std::vector<SceneObject *> const &objects);
+
+  /**
+   * Closest hit before hit.t, like calling intersects on every object.
+   */
+  bool closestHit(Ray &r, Hit &hit, CullingType culling);
+
+  /**
+   * First primitive found on the ray, or NULL.
+   */
+  SceneObject *findOccluder(Ray &r, CullingType culling);
+};
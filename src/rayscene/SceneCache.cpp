@@ -0,0 +1,122 @@
+#include <iostream>
+#include <chrono>
+#include "SceneCache.hpp"
+#include "SceneLoader.hpp"
+
+/**
+ * Margin for the coarse modification times of some file systems (down to 2 seconds)
+ */
+static const std::chrono::seconds MTIME_RESOLUTION(2);
+
+bool SceneCache::isUpToDate(CachedScene const &entry)
+{
+  for (auto const &[path, modified] : entry.modified)
+  {
+    std::error_code error;
+    if (std::filesystem::last_write_time(path, error) != modified || error)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+std::shared_ptr<const CachedScene> SceneCache::load(std::string const &path)
+{
+  std::filesystem::file_time_type loadStart = std::filesystem::file_time_type::clock::now();
+  auto [scene, camera, image] = SceneLoader::Load(path);
+
+  auto entry = std::make_shared<CachedScene>();
+  entry->scene = std::shared_ptr<Scene>(scene);
+  entry->camera = *camera;
+  entry->width = image->width;
+  entry->height = image->height;
+  delete camera;
+  delete image;
+
+  for (std::string const &file : scene->sourceFiles)
+  {
+    std::error_code error;
+    std::filesystem::file_time_type modified = std::filesystem::last_write_time(file, error);
+    // A file written during the load may have been read before the change: the next request loads it again
+    if (error || modified >= loadStart - MTIME_RESOLUTION)
+    {
+      modified = std::filesystem::file_time_type::min();
+    }
+    entry->modified[file] = modified;
+  }
+
+  // Build everything now, so that the next renders start immediately
+  scene->prepare();
+  return entry;
+}
+
+std::shared_ptr<const CachedScene> SceneCache::get(std::string const &path, bool *cached)
+{
+  std::string key = std::filesystem::weakly_canonical(path).string();
+
+  std::promise<std::shared_ptr<const CachedScene>> promise;
+  std::shared_future<std::shared_ptr<const CachedScene>> entry;
+  unsigned long long loadNumber = 0;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = entries.find(key);
+    if (it != entries.end())
+    {
+      std::shared_future<std::shared_ptr<const CachedScene>> &scene = it->second.scene;
+      // Still loading (another thread waits for it too), or loaded and up to date
+      if (scene.wait_for(std::chrono::seconds(0)) != std::future_status::ready || isUpToDate(*scene.get()))
+      {
+        entry = scene;
+      }
+    }
+    if (!entry.valid())
+    {
+      loadNumber = ++loads;
+      entries[key] = {loadNumber, promise.get_future().share()};
+    }
+  }
+
+  if (entry.valid())
+  {
+    std::shared_ptr<const CachedScene> scene = entry.get();
+    if (cached != nullptr)
+    {
+      *cached = true;
+    }
+    return scene;
+  }
+
+  // First requester loads the scene, outside of the lock
+  std::shared_ptr<const CachedScene> scene;
+  try
+  {
+    scene = load(path);
+  }
+  catch (...)
+  {
+    // The next request loads the scene again, the waiting ones get the error too
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      auto it = entries.find(key);
+      if (it != entries.end() && it->second.load == loadNumber)
+      {
+        entries.erase(it);
+      }
+    }
+    promise.set_exception(std::current_exception());
+    throw;
+  }
+  promise.set_value(scene);
+  if (cached != nullptr)
+  {
+    *cached = false;
+  }
+  return scene;
+}
+
+void SceneCache::clear()
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  entries.clear();
+}
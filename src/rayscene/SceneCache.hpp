@@ -0,0 +1,56 @@
+#pragma once
+
+#include <filesystem>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include "Scene.hpp"
+#include "Camera.hpp"
+
+/**
+ * A loaded and prepared scene, with the settings read from its file.
+ */
+struct CachedScene
+{
+  std::shared_ptr<Scene> scene;
+  Camera camera;
+  unsigned int width = 0;
+  unsigned int height = 0;
+
+  // Modification time of each source file when the scene was loaded
+  std::map<std::string, std::filesystem::file_time_type> modified;
+};
+
+/**
+ * Keeps loaded scenes (and their acceleration structures) between renders.
+ * An entry is reloaded when the scene file or one of its OBJ files is modified.
+ * Files modified while (or just before) the scene was loading count as modified.
+ * Scenes are loaded outside of the lock: a slow load only blocks the requests for the same scene.
+ */
+class SceneCache
+{
+private:
+  struct Entry
+  {
+    // Number of the load, to tell a failed load from a newer one of the same path
+    unsigned long long load;
+    std::shared_future<std::shared_ptr<const CachedScene>> scene;
+  };
+
+  std::mutex mutex;
+  std::map<std::string, Entry> entries;
+  unsigned long long loads = 0;
+
+  static bool isUpToDate(CachedScene const &entry);
+  static std::shared_ptr<const CachedScene> load(std::string const &path);
+
+public:
+  /**
+   * Returns the prepared scene, loading it if needed.
+   * If cached is not null, it is set to true when the scene came from the cache.
+   */
+  std::shared_ptr<const CachedScene> get(std::string const &path, bool *cached = nullptr);
+  void clear();
+};
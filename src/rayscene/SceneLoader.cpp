@@ -1,6 +1,7 @@
 #include <iostream>
 #include <fstream>
 #include <filesystem>
+#include <stdexcept>
 #include "../json/json.hpp"
 #include "SceneLoader.hpp"
 #include "Sphere.hpp"
@@ -11,6 +12,7 @@
 #include "Light.hpp"
 #include "PhongMaterial.hpp"
 #include "CheckerMaterial.hpp"
+#include "ThreadPool.hpp"
 
 using json = nlohmann::json;
 
@@ -54,39 +56,56 @@ void parsePhongMaterialProperties(json data, PhongMaterial *mat)
     }
 }
 
-Material *parsePhongMaterial(json data)
+Material *parsePhongMaterial(json data, Arena &arena)
 {
-    PhongMaterial *mat = new PhongMaterial();
+    PhongMaterial *mat = arena.create<PhongMaterial>();
     parsePhongMaterialProperties(data, mat);
     return mat;
 }
 
-Material *parseCheckerboardMaterial(json data)
+Material *parseCheckerboardMaterial(json data, Arena &arena)
 {
-    CheckerMaterial *mat = new CheckerMaterial();
+    CheckerMaterial *mat = arena.create<CheckerMaterial>();
     parsePhongMaterialProperties(data, mat);
     return mat;
 }
 
-Material *parseMaterial(json data)
+Material *parseMaterial(json data, Arena &arena)
 {
     std::string type = data["type"];
     if (type == "phong")
     {
-        return parsePhongMaterial(data);
+        return parsePhongMaterial(data, arena);
     }
     else if (type == "checkerboard")
     {
-        return parseCheckerboardMaterial(data);
+        return parseCheckerboardMaterial(data, arena);
     }
     return nullptr;
 }
 
-Sphere *parseSphere(json data)
+/**
+ * Material of an object, as an index in the material table of the scene
+ */
+MaterialId parseObjectMaterial(json data, Scene *scene)
+{
+    if (!data.contains("material"))
+    {
+        return NO_MATERIAL;
+    }
+    Material *mat = parseMaterial(data["material"], scene->arena);
+    if (mat == nullptr)
+    {
+        return NO_MATERIAL;
+    }
+    return scene->addMaterial(mat);
+}
+
+Sphere *parseSphere(json data, Scene *scene)
 {
     double radius = data["radius"];
 
-    Sphere *s = new Sphere(radius);
+    Sphere *s = scene->arena.create<Sphere>(radius);
     if (data.contains("position"))
     {
         Vector3 pos = parseVector3(data["position"]);
@@ -97,19 +116,12 @@ Sphere *parseSphere(json data)
         Vector3 rot = parseVector3(data["rotation"]);
         s->transform.setRotation(rot);
     }
-    if (data.contains("material"))
-    {
-        Material *mat = parseMaterial(data["material"]);
-        if (mat != nullptr)
-        {
-            s->material = mat;
-        }
-    }
+    s->materialId = parseObjectMaterial(data, scene);
 
     return s;
 }
 
-Plane *parsePlane(json data)
+Plane *parsePlane(json data, Scene *scene)
 {
     Vector3 pos;
     Vector3 norm(0, 1, 0);
@@ -123,21 +135,14 @@ Plane *parsePlane(json data)
         norm = parseVector3(data["normal"]);
     }
 
-    Plane *plane = new Plane(pos, norm);
+    Plane *plane = scene->arena.create<Plane>(pos, norm);
 
-    if (data.contains("material"))
-    {
-        Material *mat = parseMaterial(data["material"]);
-        if (mat != nullptr)
-        {
-            plane->material = mat;
-        }
-    }
+    plane->materialId = parseObjectMaterial(data, scene);
 
     return plane;
 }
 
-Triangle *parseTriangle(json data)
+Triangle *parseTriangle(json data, Scene *scene)
 {
     Vector3 pos;
     Vector3 rot;
@@ -159,13 +164,11 @@ Triangle *parseTriangle(json data)
         auto &verts = data["vertices"];
         if (!verts.is_array())
         {
-            std::cerr << "vertices entry for a an object of type triangle must be an array" << std::endl;
-            exit(1);
+            throw std::runtime_error("vertices entry for a an object of type triangle must be an array");
         }
         if (verts.size() != 3)
         {
-            std::cerr << "vertices array for a an object of type triangle must have 3 vectors" << std::endl;
-            exit(1);
+            throw std::runtime_error("vertices array for a an object of type triangle must have 3 vectors");
         }
 
         A = parseVector3(verts.at(0));
@@ -173,26 +176,28 @@ Triangle *parseTriangle(json data)
         C = parseVector3(verts.at(2));
     }
 
-    Triangle *triangle = new Triangle(A, B, C);
+    Triangle *triangle = scene->arena.create<Triangle>(A, B, C);
     triangle->transform.setPosition(pos);
     triangle->transform.setRotation(rot);
 
-    if (data.contains("material"))
-    {
-        Material *mat = parseMaterial(data["material"]);
-        if (mat != nullptr)
-        {
-            triangle->material = mat;
-        }
-    }
+    triangle->materialId = parseObjectMaterial(data, scene);
 
     return triangle;
 }
 
-Mesh *parseMesh(json data, std::filesystem::path &sceneParentPath)
+/**
+ * Mesh whose OBJ file still has to be loaded, once the whole JSON has been walked.
+ */
+struct PendingMesh
+{
+    Mesh *mesh;
+    std::string path;
+};
+
+Mesh *parseMesh(json data, Scene *scene, std::filesystem::path &sceneParentPath, std::vector<PendingMesh> &pending)
 {
 
-    Mesh *mesh = new Mesh();
+    Mesh *mesh = scene->arena.create<Mesh>();
     Vector3 pos;
     Vector3 rot;
 
@@ -216,25 +221,38 @@ Mesh *parseMesh(json data, std::filesystem::path &sceneParentPath)
         std::ifstream f(fullPath);
         if (!f.good())
         {
-            std::cerr << "obj file not found at path: " << fullPath << std::endl;
-            exit(1);
+            throw std::runtime_error("obj file not found at path: " + fullPath.string());
         }
 
-        mesh->loadFromObj(fullPath);
+        pending.push_back({mesh, fullPath.string()});
+        scene->sourceFiles.push_back(fullPath.string());
     }
 
-    if (data.contains("material"))
-    {
-        Material *mat = parseMaterial(data["material"]);
-        if (mat != nullptr)
-        {
-            mesh->material = mat;
-        }
-    }
+    mesh->materialId = parseObjectMaterial(data, scene);
 
     return mesh;
 }
 
+/**
+ * Loads the OBJ files of all the meshes in parallel.
+ * ObjCache makes sure a file referenced by several meshes is only parsed once.
+ */
+void loadMeshes(std::vector<PendingMesh> &pending, Arena &arena)
+{
+    ThreadPool &pool = ThreadPool::shared();
+    std::vector<std::future<void>> tasks;
+    for (PendingMesh &p : pending)
+    {
+        tasks.push_back(pool.submit([p, &arena]()
+                                    { p.mesh->loadFromObj(p.path, arena); }));
+    }
+    for (auto &task : tasks)
+    {
+        pool.wait(task);
+        task.get();
+    }
+}
+
 void parseOjects(json data, Scene *scene, std::filesystem::path &sceneParentPath)
 {
     if (!data.contains("objects"))
@@ -242,33 +260,37 @@ void parseOjects(json data, Scene *scene, std::filesystem::path &sceneParentPath
         return;
     }
 
+    std::vector<PendingMesh> pending;
+
     for (auto &elem : data["objects"])
     {
         std::string type = elem["type"];
         if (type == "sphere")
         {
-            Sphere *s = parseSphere(elem);
+            Sphere *s = parseSphere(elem, scene);
             scene->add(s);
         }
         else if (type == "plane")
         {
-            Plane *p = parsePlane(elem);
+            Plane *p = parsePlane(elem, scene);
             scene->add(p);
         }
         else if (type == "triangle")
         {
-            Triangle *t = parseTriangle(elem);
+            Triangle *t = parseTriangle(elem, scene);
             scene->add(t);
         }
         else if (type == "mesh")
         {
-            Mesh *m = parseMesh(elem, sceneParentPath);
+            Mesh *m = parseMesh(elem, scene, sceneParentPath, pending);
             scene->add(m);
         }
     }
+
+    loadMeshes(pending, scene->arena);
 }
 
-Light *parsePointLight(json data)
+Light *parsePointLight(json data, Scene *scene)
 {
     Vector3 pos;
     if (data.contains("position"))
@@ -276,7 +298,7 @@ Light *parsePointLight(json data)
         pos = parseVector3(data["position"]);
     }
 
-    Light *light = new Light(pos);
+    Light *light = scene->arena.create<Light>(pos);
     if (data.contains("diffuse"))
     {
         light->Diffuse = parseColor(data["diffuse"]);
@@ -301,12 +323,53 @@ void parseLights(json data, Scene *scene)
         std::string type = elem["type"];
         if (type == "point")
         {
-            Light *l = parsePointLight(elem);
+            Light *l = parsePointLight(elem, scene);
             scene->addLight(l);
         }
     }
 }
 
+void parseCamera(json data, Camera *camera)
+{
+    if (!data.contains("camera"))
+    {
+        return;
+    }
+
+    json camJson = data["camera"];
+    if (camJson.contains("position"))
+    {
+        Vector3 pos = parseVector3(camJson["position"]);
+        camera->setPosition(pos);
+    }
+    if (camJson.contains("lookAt"))
+    {
+        camera->lookAt = parseVector3(camJson["lookAt"]);
+    }
+    if (camJson.contains("up"))
+    {
+        camera->up = parseVector3(camJson["up"]);
+    }
+    if (camJson.contains("fov"))
+    {
+        camera->fov = camJson["fov"];
+        if (!(camera->fov > 0 && camera->fov < 180))
+        {
+            throw std::runtime_error("camera fov must be between 0 and 180 degrees");
+        }
+    }
+    if (camJson.contains("aspect"))
+    {
+        camera->aspect = camJson["aspect"];
+    }
+
+    Vector3 forward = camera->lookAt - camera->getPosition();
+    if (forward.length() == 0 || camera->up.cross(forward).length() == 0)
+    {
+        throw std::runtime_error("camera lookAt must differ from its position, and up must not be along the view");
+    }
+}
+
 Image *parseImage(json data, Image *image)
 {
     unsigned int width = 800;
@@ -335,8 +398,7 @@ std::tuple<Scene *, Camera *, Image *> SceneLoader::Load(std::string path)
 
     if (!f.good())
     {
-        std::cerr << "Scene file not found at path: " << path << std::endl;
-        exit(1);
+        throw std::runtime_error("Scene file not found at path: " + path);
     }
 
     // Get the parent directory of the scene file (for loading relative mesh files)
@@ -347,18 +409,76 @@ std::tuple<Scene *, Camera *, Image *> SceneLoader::Load(std::string path)
 
     Scene *scene = new Scene();
     Camera *camera = new Camera();
+    scene->sourceFiles.push_back(path);
 
-    parseLights(data, scene);
-    parseOjects(data, scene, parent_p);
-
-    if (data.contains("ambient"))
+    try
     {
-        scene->globalAmbient = parseColor(data["ambient"]);
-    }
+        parseLights(data, scene);
+        parseOjects(data, scene, parent_p);
+        parseCamera(data, camera);
 
-    if (data.contains("reflections"))
+        if (data.contains("ambient"))
+        {
+            scene->globalAmbient = parseColor(data["ambient"]);
+        }
+
+        if (data.contains("reflections"))
+        {
+            camera->Reflections = data["reflections"];
+        }
+
+        if (data.contains("lightSamples"))
+        {
+            scene->lightSamples = data["lightSamples"];
+        }
+
+        if (data.contains("shadowCache"))
+        {
+            scene->shadowCache = data["shadowCache"];
+        }
+
+        if (data.contains("tileCulling"))
+        {
+            scene->tileCulling = data["tileCulling"];
+        }
+
+        if (data.contains("bvh"))
+        {
+            std::string bvh = data["bvh"];
+            if (bvh == "sah")
+            {
+                scene->bvhSettings.method = BVH_BUILD_SAH;
+            }
+            else if (bvh == "lbvh")
+            {
+                scene->bvhSettings.method = BVH_BUILD_LBVH;
+            }
+            else if (bvh == "sbvh")
+            {
+                scene->bvhSettings.method = BVH_BUILD_SBVH;
+            }
+            else
+            {
+                throw std::runtime_error("unknown bvh build (sah, lbvh or sbvh): " + bvh);
+            }
+        }
+
+        if (data.contains("bvhSplitBudget"))
+        {
+            scene->bvhSettings.splitBudget = data["bvhSplitBudget"];
+        }
+
+        if (data.contains("bvhCompressed"))
+        {
+            scene->bvhSettings.compressed = data["bvhCompressed"];
+        }
+    }
+    catch (...)
     {
-        camera->Reflections = data["reflections"];
+        // Long-running modes (server, batch) keep going after a bad scene
+        delete scene;
+        delete camera;
+        throw;
     }
 
     Image *image = parseImage(data, image);
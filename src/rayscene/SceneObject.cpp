@@ -2,7 +2,7 @@
 #include "SceneObject.hpp"
 #include "Intersection.hpp"
 
-SceneObject::SceneObject() : material(NULL)
+SceneObject::SceneObject() : materialId(NO_MATERIAL)
 {
 }
 
@@ -10,11 +10,28 @@ SceneObject::~SceneObject()
 {
 }
 
-bool SceneObject::intersects(Ray &r, Intersection &intersection, CullingType culling)
+bool SceneObject::intersects(Ray &r, Hit &hit, CullingType culling)
 {
   return false;
 }
 
+void SceneObject::fillIntersection(Ray &r, Hit const &hit, Intersection &intersection)
+{
+  intersection.Position = hit.position(r);
+  intersection.MatId = this->materialId;
+}
+
 void SceneObject::applyTransform()
 {
 }
+
+SceneObject *SceneObject::findOccluder(Ray &r, CullingType culling)
+{
+  Hit hit;
+  return intersects(r, hit, culling) ? this : NULL;
+}
+
+bool SceneObject::getBounds(Bounds &bounds)
+{
+  return false;
+}
@@ -2,6 +2,7 @@
 #include "../raymath/Ray.hpp"
 #include "Intersection.hpp"
 #include "Material.hpp"
+#include "Bounds.hpp"
 #include "../raymath/Transform.hpp"
 
 enum CullingType
@@ -11,17 +12,48 @@ enum CullingType
   CULLING_BOTH   // Always interest
 };
 
+/**
+ * What a traversal looks for: the closest hit (camera and reflection rays),
+ * or any hit (shadow rays), in which case it stops at the first one.
+ */
+enum QueryType
+{
+  QUERY_CLOSEST,
+  QUERY_ANY
+};
+
 class SceneObject
 {
 private:
 public:
   std::string name = "";
-  Material *material = NULL;
+  MaterialId materialId = NO_MATERIAL;
   Transform transform;
 
   SceneObject();
   ~SceneObject();
 
   virtual void applyTransform();
-  virtual bool intersects(Ray &r, Intersection &intersection, CullingType culling);
+  /**
+   * Looks for a hit closer than hit.t. If there is one, it is recorded in hit
+   * (t and primitive only, nothing is computed for shading) and true is returned.
+   */
+  virtual bool intersects(Ray &r, Hit &hit, CullingType culling);
+
+  /**
+   * Position, normal and material of a hit returned by intersects (called on hit.primitive).
+   */
+  virtual void fillIntersection(Ray &r, Hit const &hit, Intersection &intersection);
+
+  /**
+   * Any primitive of this object hit by the ray (not necessarily the closest), or NULL.
+   * Used by shadow rays, for which any hit means the light is blocked.
+   */
+  virtual SceneObject *findOccluder(Ray &r, CullingType culling);
+
+  /**
+   * Box containing the object once transformed. Returns false for unbounded objects (planes)
+   * or objects without a known box.
+   */
+  virtual bool getBounds(Bounds &bounds);
 };
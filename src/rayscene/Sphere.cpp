@@ -19,7 +19,8 @@ void Sphere::applyTransform()
 
 // Fonction countPrimes supprimée (Optimisation #1)
 
-bool Sphere::intersects(Ray &r, Intersection &intersection, CullingType culling)
+// Spheres are hit from both sides whatever the culling (the ray may start inside)
+bool Sphere::intersects(Ray &r, Hit &hit, [[maybe_unused]] CullingType culling)
 {
   Vector3 OC = center - r.GetPosition();
   Vector3 OP = OC.projectOn(r.GetDirection());
@@ -42,13 +43,34 @@ bool Sphere::intersects(Ray &r, Intersection &intersection, CullingType culling)
   // CORRECTION DE L'ERREUR : On utilise 'distSquared' au lieu de 'distance * distance'
   double a = sqrt(radius * radius - distSquared);
   double t = OP.length() - a;
-  Vector3 P1 = r.GetPosition() + (r.GetDirection() * t);
+  // t is negative when the ray starts inside the sphere (its center being ahead): the sphere
+  // still counts as hit, and as the closest one (shadow rays rely on it, see PhongMaterial)
+  if (t >= hit.t)
+  {
+    return false;
+  }
 
-  intersection.Position = P1;
-  intersection.Mat = this->material;
-  intersection.Normal = (P1 - center).normalize();
+  hit.t = t;
+  hit.primitive = this;
 
   // countPrimes(); <-- Supprimé
 
   return true;
-}
\ No newline at end of file
+}
+
+void Sphere::fillIntersection(Ray &r, Hit const &hit, Intersection &intersection)
+{
+  Vector3 P1 = hit.position(r);
+
+  intersection.Position = P1;
+  intersection.MatId = this->materialId;
+  intersection.Normal = (P1 - center).normalize();
+}
+
+bool Sphere::getBounds(Bounds &bounds)
+{
+  bounds = Bounds();
+  bounds.grow(center - Vector3(radius, radius, radius));
+  bounds.grow(center + Vector3(radius, radius, radius));
+  return true;
+}
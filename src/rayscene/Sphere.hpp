@@ -14,7 +14,12 @@ public:
   Sphere(double r);
   ~Sphere();
 
+  Vector3 const &getCenter() const { return center; }
+  double getRadius() const { return radius; }
+
   virtual void applyTransform() override;
-  virtual bool intersects(Ray &r, Intersection &intersection, CullingType culling) override;
+  virtual bool intersects(Ray &r, Hit &hit, CullingType culling) override;
+  virtual void fillIntersection(Ray &r, Hit const &hit, Intersection &intersection) override;
+  virtual bool getBounds(Bounds &bounds) override;
   void countPrimes();
 };
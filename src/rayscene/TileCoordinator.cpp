@@ -0,0 +1,327 @@
+#include <iostream>
+#include <cstring>
+#include <filesystem>
+#include <thread>
+#include <spawn.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "../json/json.hpp"
+#include "TileCoordinator.hpp"
+
+using json = nlohmann::json;
+
+extern char **environ;
+
+TileCoordinator::TileCoordinator(std::string scene, std::string exe) : scenePath(scene), executable(exe)
+{
+}
+
+TileCoordinator::~TileCoordinator()
+{
+}
+
+std::vector<ImageRegion> TileCoordinator::split(unsigned int width, unsigned int height, unsigned int count)
+{
+  // Horizontal bands of (almost) the same height
+  count = std::max(1u, std::min(count, height));
+  std::vector<ImageRegion> tiles;
+  for (unsigned int i = 0; i < count; ++i)
+  {
+    ImageRegion tile;
+    tile.x0 = 0;
+    tile.x1 = width;
+    tile.y0 = (unsigned long long)height * i / count;
+    tile.y1 = (unsigned long long)height * (i + 1) / count;
+    tiles.push_back(tile);
+  }
+  return tiles;
+}
+
+std::string TileCoordinator::tilePath(size_t index)
+{
+  std::string name = "raytracer-" + std::to_string(getpid()) + "-tile-" + std::to_string(index) + ".raw";
+  return (std::filesystem::temp_directory_path() / name).string();
+}
+
+bool TileCoordinator::gather(Image &image, std::vector<ImageRegion> const &tiles)
+{
+  bool ok = true;
+  for (size_t i = 0; i < tiles.size(); ++i)
+  {
+    std::string path = tilePath(i);
+    Image *tile = Image::readRaw(path, tiles[i].width(), tiles[i].height());
+    if (tile == NULL)
+    {
+      std::cerr << "[ERROR] Missing tile " << i << ": " << path << std::endl;
+      ok = false;
+      continue;
+    }
+    image.paste(*tile, tiles[i].x0, tiles[i].y0);
+    delete tile;
+    std::filesystem::remove(path);
+  }
+  return ok;
+}
+
+bool TileCoordinator::renderWithProcesses(Image &image, unsigned int processes)
+{
+  std::vector<ImageRegion> tiles = split(image.width, image.height, processes);
+
+  // The workers only report errors
+  posix_spawn_file_actions_t actions;
+  posix_spawn_file_actions_init(&actions);
+  posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+
+  std::vector<pid_t> workers;
+  bool ok = true;
+  for (size_t i = 0; i < tiles.size(); ++i)
+  {
+    std::string output = tilePath(i);
+    std::string region = std::to_string(tiles[i].x0) + "," + std::to_string(tiles[i].y0) + "," +
+                         std::to_string(tiles[i].x1) + "," + std::to_string(tiles[i].y1);
+    std::vector<std::string> args = {executable, scenePath, output, "--region", region};
+
+    std::vector<char *> argv;
+    for (std::string &arg : args)
+    {
+      argv.push_back(&arg[0]);
+    }
+    argv.push_back(NULL);
+
+    pid_t pid;
+    if (posix_spawnp(&pid, executable.c_str(), &actions, NULL, argv.data(), environ) != 0)
+    {
+      std::cerr << "[ERROR] Could not start worker: " << executable << std::endl;
+      ok = false;
+      continue;
+    }
+    workers.push_back(pid);
+  }
+  posix_spawn_file_actions_destroy(&actions);
+
+  for (pid_t pid : workers)
+  {
+    int status;
+    if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+    {
+      std::cerr << "[ERROR] Worker " << pid << " failed" << std::endl;
+      ok = false;
+    }
+  }
+
+  return gather(image, tiles) && ok;
+}
+
+/**
+ * Writes all of data, retrying after partial writes. MSG_NOSIGNAL: a closed connection is an error, not a SIGPIPE.
+ */
+static bool sendAll(int fd, std::string const &data)
+{
+  size_t written = 0;
+  while (written < data.size())
+  {
+    ssize_t n = send(fd, data.data() + written, data.size() - written, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR)
+    {
+      continue;
+    }
+    if (n <= 0)
+    {
+      return false;
+    }
+    written += n;
+  }
+  return true;
+}
+
+/**
+ * Reads from the connection into pending until done(pending) is true. Returns false if the connection ends first.
+ */
+template <typename Done>
+static bool receive(int fd, std::string &pending, Done done)
+{
+  char buffer[64 * 1024];
+  while (!done(pending))
+  {
+    ssize_t count = read(fd, buffer, sizeof(buffer));
+    if (count < 0 && errno == EINTR)
+    {
+      continue;
+    }
+    if (count <= 0)
+    {
+      return false;
+    }
+    pending.append(buffer, count);
+  }
+  return true;
+}
+
+/**
+ * Next tile to render. Waits while the queue is empty but tiles are still being rendered
+ * (they come back to the queue if their server fails). Returns false when every tile is done.
+ */
+bool TileCoordinator::takeTile(size_t &index)
+{
+  std::unique_lock<std::mutex> lock(mutex);
+  changed.wait(lock, [this]()
+               { return !queue.empty() || inFlight == 0; });
+  if (queue.empty())
+  {
+    return false;
+  }
+  index = queue.front();
+  queue.pop_front();
+  inFlight++;
+  return true;
+}
+
+void TileCoordinator::finishTile(size_t index, bool rendered)
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!rendered)
+    {
+      queue.push_back(index);
+    }
+    inFlight--;
+  }
+  changed.notify_all();
+}
+
+bool TileCoordinator::renderOnServer(std::string const &socketPath, std::vector<ImageRegion> const &tiles, Image &image,
+                                     std::vector<bool> &done)
+{
+  sockaddr_un address;
+  std::memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  std::strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0 || connect(fd, (sockaddr *)&address, sizeof(address)) < 0)
+  {
+    std::cerr << "[ERROR] Could not connect to worker " << socketPath << ": " << std::strerror(errno) << std::endl;
+    if (fd >= 0)
+    {
+      close(fd);
+    }
+    return false;
+  }
+
+  std::string pending;
+  size_t index;
+  while (takeTile(index))
+  {
+    ImageRegion const &tile = tiles[index];
+    json request;
+    request["scene"] = std::filesystem::absolute(scenePath).string();
+    request["inline"] = true;
+    request["width"] = image.width;
+    request["height"] = image.height;
+    request["region"] = std::to_string(tile.x0) + "," + std::to_string(tile.y0) + "," +
+                        std::to_string(tile.x1) + "," + std::to_string(tile.y1);
+
+    // The answer line, then the pixels of the tile
+    Image *pixels = NULL;
+    std::string error;
+    size_t end;
+    if (!sendAll(fd, request.dump() + "\n") ||
+        !receive(fd, pending, [&](std::string const &data)
+                 { return (end = data.find('\n')) != std::string::npos; }))
+    {
+      error = "connection lost";
+    }
+    else
+    {
+      try
+      {
+        json response = json::parse(pending.substr(0, end));
+        pending.erase(0, end + 1);
+        if (response["status"] != "ok")
+        {
+          error = response.dump();
+        }
+        else
+        {
+          size_t bytes = response["bytes"];
+          if (!receive(fd, pending, [&](std::string const &data)
+                       { return data.size() >= bytes; }))
+          {
+            error = "connection lost";
+          }
+          else
+          {
+            pixels = Image::fromRaw(pending.substr(0, bytes), tile.width(), tile.height());
+            pending.erase(0, bytes);
+            if (pixels == NULL)
+            {
+              error = "tile of the wrong size";
+            }
+          }
+        }
+      }
+      catch (std::exception const &e)
+      {
+        error = std::string("invalid answer: ") + e.what();
+      }
+    }
+
+    if (pixels == NULL)
+    {
+      // Someone else renders the tile, this server gets no more of them
+      std::cerr << "[ERROR] Worker " << socketPath << ", tile " << index << ": " << error << std::endl;
+      finishTile(index, false);
+      close(fd);
+      return false;
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      image.paste(*pixels, tile.x0, tile.y0);
+      done[index] = true;
+    }
+    delete pixels;
+    finishTile(index, true);
+  }
+
+  close(fd);
+  return true;
+}
+
+bool TileCoordinator::renderWithServers(Image &image, std::vector<std::string> const &sockets)
+{
+  // Several tiles per server, so that fast servers take more of them
+  std::vector<ImageRegion> tiles = split(image.width, image.height, sockets.size() * 4);
+  std::vector<bool> done(tiles.size(), false);
+  queue.clear();
+  for (size_t i = 0; i < tiles.size(); ++i)
+  {
+    queue.push_back(i);
+  }
+  inFlight = 0;
+
+  std::vector<std::thread> threads;
+  for (std::string const &socketPath : sockets)
+  {
+    threads.emplace_back([&, socketPath]()
+                         { renderOnServer(socketPath, tiles, image, done); });
+  }
+  for (auto &t : threads)
+  {
+    t.join();
+  }
+
+  bool ok = true;
+  for (size_t i = 0; i < tiles.size(); ++i)
+  {
+    if (!done[i])
+    {
+      std::cerr << "[ERROR] Tile " << i << " was not rendered" << std::endl;
+      ok = false;
+    }
+  }
+  return ok;
+}
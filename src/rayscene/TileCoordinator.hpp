@@ -0,0 +1,54 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "../rayimage/Image.hpp"
+
+/**
+ * Splits a frame into tiles rendered by other processes, and stitches them back into one image.
+ * Workers are either local processes started for the frame (raytracer <scene> <tile.raw> --region ...),
+ * which write their tile as a raw float file, or render servers (--serve) listening on Unix sockets,
+ * which send their tiles back on the connection. Either way the stitched image is identical to a render
+ * done in one process.
+ */
+class TileCoordinator
+{
+private:
+  std::string scenePath;
+  std::string executable;
+
+  // Tiles handed out to the render servers
+  std::mutex mutex;
+  std::condition_variable changed;
+  std::deque<size_t> queue;
+  size_t inFlight = 0;
+
+  static std::vector<ImageRegion> split(unsigned int width, unsigned int height, unsigned int count);
+  std::string tilePath(size_t index);
+  bool takeTile(size_t &index);
+  void finishTile(size_t index, bool rendered);
+  bool renderOnServer(std::string const &socketPath, std::vector<ImageRegion> const &tiles, Image &image,
+                      std::vector<bool> &done);
+  bool gather(Image &image, std::vector<ImageRegion> const &tiles);
+
+public:
+  /**
+   * executable is the raytracer started for the local workers.
+   */
+  TileCoordinator(std::string scene, std::string executable);
+  ~TileCoordinator();
+
+  /**
+   * Renders the image with the given number of local worker processes.
+   */
+  bool renderWithProcesses(Image &image, unsigned int processes);
+
+  /**
+   * Renders the image with render servers (several tiles per server, handed out as they finish).
+   * The tiles of a server that fails are given to the other servers.
+   */
+  bool renderWithServers(Image &image, std::vector<std::string> const &sockets);
+};
@@ -19,66 +19,31 @@ void Triangle::applyTransform()
   tC = this->transform.apply(C);
 }
 
-bool Triangle::intersects(Ray &r, Intersection &intersection, CullingType culling)
+bool Triangle::intersects(Ray &r, Hit &hit, CullingType culling)
 {
-  Vector3 BA = tB - tA;
-  Vector3 CA = tC - tA;
-  Vector3 normal = BA.cross(CA).normalize();
-
-  // Ray plane intersection
-  float denom = r.GetDirection().dot(normal);
-
-  //
-  // If denom == 0 - it is parallel to the plane
-  // If denom > 0, it means plane is behind the ray
-  if (culling == CULLING_FRONT && denom > -0.000001)
-  {
-    return false;
-  }
-  if (culling == CULLING_BACK && denom < 0.000001)
-  {
-    return false;
-  }
-
-  float numer = (tA - r.GetPosition()).dot(normal);
-  float t = numer / denom;
-
-  // Behind the ray
-  if (t <= 0)
-  {
-    return false;
-  }
-
-  // Point on plane
-  Vector3 Q = r.GetPosition() + (r.GetDirection() * t);
-
-  // Point contained in triangle
-  Vector3 QA = Q - tA;
-  Vector3 BAxQA = BA.cross(QA);
-  if (BAxQA.dot(normal) < 0)
+  switch (culling)
   {
-    return false;
-  }
-
-  Vector3 CB = tC - tB;
-  Vector3 QB = Q - tB;
-  Vector3 CBxQB = CB.cross(QB);
-  if (CBxQB.dot(normal) < 0)
-  {
-    return false;
-  }
-
-  Vector3 AC = tA - tC;
-  Vector3 QC = Q - tC;
-  Vector3 ACxQC = AC.cross(QC);
-  if (ACxQC.dot(normal) < 0)
-  {
-    return false;
+  case CULLING_FRONT:
+    return hitTest<CULLING_FRONT, QUERY_CLOSEST>(r, hit);
+  case CULLING_BACK:
+    return hitTest<CULLING_BACK, QUERY_CLOSEST>(r, hit);
+  default:
+    return hitTest<CULLING_BOTH, QUERY_CLOSEST>(r, hit);
   }
+}
 
-  intersection.Position = Q;
-  intersection.Mat = this->material;
-  intersection.Normal = normal;
+void Triangle::fillIntersection(Ray &r, Hit const &hit, Intersection &intersection)
+{
+  intersection.Position = hit.position(r);
+  intersection.MatId = this->materialId;
+  intersection.Normal = (tB - tA).cross(tC - tA).normalize();
+}
 
+bool Triangle::getBounds(Bounds &bounds)
+{
+  bounds = Bounds();
+  bounds.grow(tA);
+  bounds.grow(tB);
+  bounds.grow(tC);
   return true;
-}
\ No newline at end of file
+}
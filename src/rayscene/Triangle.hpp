@@ -24,5 +24,89 @@ public:
   int ID;
 
   virtual void applyTransform() override;
-  virtual bool intersects(Ray &r, Intersection &intersection, CullingType culling) override;
+  virtual bool intersects(Ray &r, Hit &hit, CullingType culling) override;
+
+  /**
+   * Intersection test specialized at compile time for a culling mode and a query type.
+   * Called directly (not virtual) by the mesh traversal, which selects the variant once per ray.
+   */
+  template <CullingType Culling, QueryType Query>
+  bool hitTest(Ray &r, Hit &hit);
+  virtual void fillIntersection(Ray &r, Hit const &hit, Intersection &intersection) override;
+  virtual bool getBounds(Bounds &bounds) override;
 };
+
+template <CullingType Culling, QueryType Query>
+inline bool Triangle::hitTest(Ray &r, Hit &hit)
+{
+  Vector3 BA = tB - tA;
+  Vector3 CA = tC - tA;
+  Vector3 cross = BA.cross(CA);
+  Vector3 normal = cross.normalize();
+
+  // Ray plane intersection
+  float denom = r.GetDirection().dot(normal);
+
+  //
+  // If denom == 0 - it is parallel to the plane
+  // If denom > 0, it means plane is behind the ray
+  if (Culling == CULLING_FRONT && denom > -0.000001)
+  {
+    return false;
+  }
+  if (Culling == CULLING_BACK && denom < 0.000001)
+  {
+    return false;
+  }
+
+  float numer = (tA - r.GetPosition()).dot(normal);
+  float t = numer / denom;
+
+  // Behind the ray, or farther than the closest hit so far
+  if (t <= 0 || t >= hit.t)
+  {
+    return false;
+  }
+
+  // Point on plane
+  Vector3 Q = r.GetPosition() + (r.GetDirection() * t);
+
+  // Point contained in triangle
+  Vector3 QA = Q - tA;
+  Vector3 BAxQA = BA.cross(QA);
+  double wC = BAxQA.dot(normal);
+  if (wC < 0)
+  {
+    return false;
+  }
+
+  Vector3 CB = tC - tB;
+  Vector3 QB = Q - tB;
+  Vector3 CBxQB = CB.cross(QB);
+  double wA = CBxQB.dot(normal);
+  if (wA < 0)
+  {
+    return false;
+  }
+
+  Vector3 AC = tA - tC;
+  Vector3 QC = Q - tC;
+  Vector3 ACxQC = AC.cross(QC);
+  double wB = ACxQC.dot(normal);
+  if (wB < 0)
+  {
+    return false;
+  }
+
+  hit.t = t;
+  hit.primitive = this;
+  if (Query == QUERY_CLOSEST)
+  {
+    // The sub-triangle areas over the area of the triangle
+    double area = cross.dot(normal);
+    hit.u = wB / area;
+    hit.v = wC / area;
+  }
+
+  return true;
+}
@@ -0,0 +1,83 @@
+#include <iostream>
+#include "ThreadPool.hpp"
+
+ThreadPool::ThreadPool(unsigned int threadCount)
+{
+  if (threadCount == 0)
+  {
+    threadCount = std::thread::hardware_concurrency();
+  }
+  if (threadCount == 0)
+  {
+    threadCount = 4; // Safety if the detection fails
+  }
+
+  for (unsigned int i = 0; i < threadCount; ++i)
+  {
+    workers.emplace_back(&ThreadPool::workerLoop, this);
+  }
+}
+
+ThreadPool::~ThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  available.notify_all();
+
+  for (auto &t : workers)
+  {
+    if (t.joinable())
+    {
+      t.join();
+    }
+  }
+}
+
+unsigned int ThreadPool::size() const
+{
+  return workers.size();
+}
+
+void ThreadPool::workerLoop()
+{
+  while (true)
+  {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      available.wait(lock, [this]()
+                     { return stopping || !tasks.empty(); });
+      if (tasks.empty())
+      {
+        return; // stopping and nothing left to do
+      }
+      task = std::move(tasks.front());
+      tasks.pop();
+    }
+    task();
+  }
+}
+
+bool ThreadPool::runPendingTask()
+{
+  std::function<void()> task;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (tasks.empty())
+    {
+      return false;
+    }
+    task = std::move(tasks.front());
+    tasks.pop();
+  }
+  task();
+  return true;
+}
+
+ThreadPool &ThreadPool::shared()
+{
+  static ThreadPool pool;
+  return pool;
+}
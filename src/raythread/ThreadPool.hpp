@@ -0,0 +1,77 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+/**
+ * Fixed-size pool of worker threads consuming a FIFO queue of tasks.
+ * Tasks are submitted as callables and their result is returned through a std::future.
+ */
+class ThreadPool
+{
+private:
+  std::vector<std::thread> workers;
+  std::queue<std::function<void()>> tasks;
+  std::mutex mutex;
+  std::condition_variable available;
+  bool stopping = false;
+
+  void workerLoop();
+
+public:
+  /**
+   * Creates a pool with the given number of threads (0 = one per logical core).
+   */
+  ThreadPool(unsigned int threadCount = 0);
+  ~ThreadPool();
+
+  unsigned int size() const;
+
+  template <typename F>
+  auto submit(F &&task) -> std::future<decltype(task())>
+  {
+    using Result = decltype(task());
+    auto packaged = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(task));
+    std::future<Result> result = packaged->get_future();
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      tasks.emplace([packaged]()
+                    { (*packaged)(); });
+    }
+    available.notify_one();
+    return result;
+  }
+
+  /**
+   * Runs one queued task on the calling thread, if any.
+   * Used to keep waiting threads busy (and avoid deadlocks when a task waits on sub-tasks).
+   */
+  bool runPendingTask();
+
+  /**
+   * Waits for the future while helping with the queued tasks.
+   */
+  template <typename T>
+  void wait(std::future<T> &future)
+  {
+    while (future.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+    {
+      if (!runPendingTask())
+      {
+        future.wait_for(std::chrono::microseconds(100));
+      }
+    }
+  }
+
+  /**
+   * Pool shared by the whole process (scene loading, image encoding...).
+   */
+  static ThreadPool &shared();
+};
@@ -0,0 +1,79 @@
+#include <iostream>
+#include <string>
+#include <tuple>
+#include "SceneLoader.hpp"
+#include "Mesh.hpp"
+
+// Meshes of a scene, once prepared
+static std::vector<Mesh *> meshes(Scene &scene) {
+    std::vector<Mesh *> result;
+    for (SceneObject *object : scene.getObjects()) {
+        if (Mesh *mesh = dynamic_cast<Mesh *>(object)) {
+            result.push_back(mesh);
+        }
+    }
+    return result;
+}
+
+// Checks that the BVH option of a scene took effect on its meshes: the trees are compared with the default
+// ones (SAH, uncompressed), built from the same file with the BVH settings reset.
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        std::cerr << "Usage: " << argv[0] << " <scene.json> <lbvh|sbvh|compressed>" << std::endl;
+        return 1;
+    }
+    std::string option = argv[2];
+
+    Scene *scene, *defaultScene;
+    Camera *camera;
+    Image *image;
+    std::tie(scene, camera, image) = SceneLoader::Load(argv[1]);
+    delete camera;
+    delete image;
+    std::tie(defaultScene, camera, image) = SceneLoader::Load(argv[1]);
+    delete camera;
+    delete image;
+    BVHSettings settings = scene->bvhSettings;
+    defaultScene->bvhSettings = BVHSettings();
+    scene->prepare();
+    defaultScene->prepare();
+
+    std::vector<Mesh *> tested = meshes(*scene);
+    std::vector<Mesh *> defaults = meshes(*defaultScene);
+    if (tested.empty()) {
+        std::cerr << "No mesh in the scene" << std::endl;
+        return 1;
+    }
+
+    bool ok = true;
+    for (int i = 0; i < tested.size(); ++i) {
+        BVH const &bvh = tested[i]->getBVH();
+        BVH const &defaultBvh = defaults[i]->getBVH();
+        int triangles = tested[i]->getTriangleCount();
+        std::cout << "Mesh " << i << ": " << triangles << " triangles, " << bvh.order.size() << " references, "
+                  << bvh.nodes.size() << " nodes, " << bvh.compactNodes.size() << " compressed nodes (SAH: "
+                  << defaultBvh.nodes.size() << " nodes)" << std::endl;
+
+        if (option == "lbvh") {
+            // The Morton curve groups the triangles differently from the SAH
+            ok = ok && bvh.nodes.size() != defaultBvh.nodes.size();
+        } else if (option == "sbvh") {
+            // Spatial splits reference some triangles twice, within the budget
+            ok = ok && bvh.order.size() > triangles && bvh.order.size() <= triangles * (1 + settings.splitBudget);
+        } else if (option == "compressed") {
+            ok = ok && !bvh.compactNodes.empty() && bvh.nodes.empty();
+        } else {
+            std::cerr << "Unknown option: " << option << std::endl;
+            return 1;
+        }
+    }
+
+    delete scene;
+    delete defaultScene;
+    if (!ok) {
+        std::cerr << "The " << option << " option did not take effect" << std::endl;
+        return 1;
+    }
+    std::cout << "The " << option << " option took effect" << std::endl;
+    return 0;
+}
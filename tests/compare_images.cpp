@@ -2,15 +2,72 @@
 #include <vector>
 #include <string>
 #include <cmath>
+#include <fstream>
 #include "lodepng.h"
 
+// Same conversion to 8 bits as the PNG and PPM writers of the raytracer
+static unsigned char toByte(float value) {
+    return (unsigned int)floor(value * 255);
+}
+
+// Loads an image as 8 bits RGBA, like lodepng::decode. Besides PNG, reads the other formats written by the
+// raytracer: .ppm (8 bits), .pfm and .raw (float RGB). A .raw file has no header: it takes the size w x h given.
+// Returns an error message, empty on success.
+static std::string loadImage(std::string const &file, std::vector<unsigned char> &rgba, unsigned &w, unsigned &h) {
+    std::string extension = file.size() >= 4 ? file.substr(file.size() - 4) : "";
+    if (extension != ".ppm" && extension != ".pfm" && extension != ".raw") {
+        unsigned error = lodepng::decode(rgba, w, h, file);
+        return error ? lodepng_error_text(error) : "";
+    }
+
+    std::ifstream in(file, std::ios::binary);
+    if (!in.good()) {
+        return "cannot open file";
+    }
+    bool floats = extension != ".ppm";
+    bool bottomUp = extension == ".pfm";
+    if (extension != ".raw") {
+        std::string magic;
+        double maximum;
+        in >> magic >> w >> h >> maximum;
+        in.get(); // single whitespace before the pixels
+        if (magic != (floats ? "PF" : "P6")) {
+            return "unexpected header " + magic;
+        }
+    }
+
+    size_t channels = (size_t)w * h * 3;
+    std::vector<unsigned char> bytes(channels);
+    if (floats) {
+        std::vector<float> values(channels);
+        in.read((char *)values.data(), channels * sizeof(float));
+        for (size_t i = 0; i < channels; ++i) bytes[i] = toByte(values[i]);
+    } else {
+        in.read((char *)bytes.data(), channels);
+    }
+    if (!in.good()) {
+        return "file too small";
+    }
+
+    rgba.assign((size_t)w * h * 4, 255);
+    for (unsigned y = 0; y < h; ++y) {
+        unsigned row = bottomUp ? h - 1 - y : y;
+        for (unsigned x = 0; x < w; ++x) {
+            for (int c = 0; c < 3; ++c) {
+                rgba[((size_t)y * w + x) * 4 + c] = bytes[((size_t)row * w + x) * 3 + c];
+            }
+        }
+    }
+    return "";
+}
+
 // Returns 0 if images are similar, 1 otherwise
 int main(int argc, char* argv[]) {
     // Si on n'a pas d'image de référence (ex: cas limite nouveau), on peut générer une image noire ou juste valider que le fichier existe.
     // Pour l'instant on garde la logique de comparaison.
     
     if (argc < 3) {
-        std::cerr << "Usage: " << argv[0] << " <image1.png> <image2.png> [tolerance]" << std::endl;
+        std::cerr << "Usage: " << argv[0] << " <image1> <image2.png> [tolerance] [mean tolerance] (image1: .png, .ppm, .pfm or .raw)" << std::endl;
         return 1;
     }
 
@@ -20,19 +77,27 @@ int main(int argc, char* argv[]) {
     if (argc > 3) {
         tolerance = std::stod(argv[3]);
     }
+    // Optional bound on the average difference, for noisy (sampled) images
+    double meanTolerance = -1;
+    if (argc > 4) {
+        meanTolerance = std::stod(argv[4]);
+    }
 
     std::vector<unsigned char> image1, image2;
     unsigned w1, h1, w2, h2;
 
-    unsigned error1 = lodepng::decode(image1, w1, h1, file1);
-    if (error1) {
-        std::cerr << "Error loading " << file1 << ": " << lodepng_error_text(error1) << std::endl;
+    // The reference first: a .raw output has the size of the reference
+    std::string error2 = loadImage(file2, image2, w2, h2);
+    if (!error2.empty()) {
+        std::cerr << "Error loading " << file2 << ": " << error2 << std::endl;
         return 1;
     }
 
-    unsigned error2 = lodepng::decode(image2, w2, h2, file2);
-    if (error2) {
-        std::cerr << "Error loading " << file2 << ": " << lodepng_error_text(error2) << std::endl;
+    w1 = w2;
+    h1 = h2;
+    std::string error1 = loadImage(file1, image1, w1, h1);
+    if (!error1.empty()) {
+        std::cerr << "Error loading " << file1 << ": " << error1 << std::endl;
         return 1;
     }
 
@@ -44,10 +109,12 @@ int main(int argc, char* argv[]) {
     // Compare pixels
     size_t diff_count = 0;
     size_t total_pixels = w1 * h1;
+    double diff_sum = 0;
     
     for (size_t i = 0; i < image1.size(); ++i) {
         int val1 = image1[i];
         int val2 = image2[i];
+        diff_sum += std::abs(val1 - val2);
         if (std::abs(val1 - val2) > tolerance) {
              diff_count++;
         }
@@ -58,6 +125,13 @@ int main(int argc, char* argv[]) {
         return 1;
     }
 
+    // RGB bytes only: the alpha channel is always 255
+    double mean = diff_sum / (total_pixels * 3);
+    if (meanTolerance >= 0 && mean > meanTolerance) {
+        std::cerr << "FAIL: mean difference " << mean << " (Tolerance: " << meanTolerance << ")" << std::endl;
+        return 1;
+    }
+
     std::cout << "SUCCESS: Images match." << std::endl;
     return 0;
 }